@@ -0,0 +1,211 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+#include "avrc_meta.h"
+
+#ifdef ESP_PLATFORM
+#include "sys/lock.h"
+#else
+typedef int _lock_t;
+#define _lock_acquire(l)	((void)(l))
+#define _lock_release(l)	((void)(l))
+#endif
+
+#ifdef CONFIG_EXAMPLE_AVRC_META_ARENA
+#define AVRC_META_ARENA		CONFIG_EXAMPLE_AVRC_META_ARENA
+#else
+#define AVRC_META_ARENA		256	// bytes for all texts
+#endif
+
+/*
+ * The texts are packed in the arena in no particular order. A changed
+ * text is removed by moving the texts behind it down, then appended,
+ * truncated to the free space at a UTF-8 character boundary.
+ */
+typedef struct {
+    uint16_t offset;
+    uint16_t len;			// 0: no text
+} avrc_meta_text_t;
+
+static char meta_arena[AVRC_META_ARENA];
+static size_t meta_used;
+static avrc_meta_text_t meta_text[AVRC_META_ATTRS];
+static uint8_t meta_uid[AVRC_META_UID_SIZE];
+static bool meta_uid_valid;
+static uint32_t meta_track;
+static uint8_t meta_valid;		// attributes answered for the current track
+static uint8_t meta_pending;		// attributes requested, not answered yet
+static uint32_t meta_pending_ms;
+static uint8_t meta_changed;
+static _lock_t meta_lock;
+
+// attribute bit to index, -1 when not a single known attribute
+static int avrc_meta_index(uint8_t attr)
+{
+    for (int i = 0; i < AVRC_META_ATTRS; i++) {
+	if (attr == (1 << i)) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+// whether the UID identifies a track
+static bool avrc_meta_uid_usable(const uint8_t *uid)
+{
+    uint8_t all_or = 0, all_and = 0xff;
+
+    if (!uid) {
+	return false;
+    }
+    for (int i = 0; i < AVRC_META_UID_SIZE; i++) {
+	all_or |= uid[i];
+	all_and &= uid[i];
+    }
+    return all_or != 0 && all_and != 0xff;
+}
+
+// forget the track and the texts
+void avrc_meta_reset(void)
+{
+    _lock_acquire(&meta_lock);
+    meta_used = 0;
+    memset(meta_text, 0, sizeof(meta_text));
+    meta_uid_valid = false;
+    meta_track++;
+    meta_valid = meta_pending = meta_changed = 0;
+    _lock_release(&meta_lock);
+}
+
+// track changed, return attributes to request
+uint8_t avrc_meta_track_changed(const uint8_t *uid, uint8_t attrs, uint32_t now_ms)
+{
+    uint8_t request;
+
+    _lock_acquire(&meta_lock);
+    if (!uid || (meta_uid_valid && avrc_meta_uid_usable(uid) &&
+		 memcmp(uid, meta_uid, AVRC_META_UID_SIZE) == 0)) {
+	// same track, request what is neither known nor on its way
+	if (meta_pending && now_ms - meta_pending_ms >= AVRC_META_PENDING_MS) {
+	    meta_pending = 0;
+	}
+	request = attrs & ~(meta_valid | meta_pending);
+    } else {
+	// new track, the texts stay for comparison until answered
+	meta_uid_valid = avrc_meta_uid_usable(uid);
+	if (meta_uid_valid) {
+	    memcpy(meta_uid, uid, AVRC_META_UID_SIZE);
+	}
+	meta_track++;
+	meta_valid = meta_pending = 0;
+	request = attrs;
+    }
+    if (request) {
+	meta_pending |= request;
+	meta_pending_ms = now_ms;
+    }
+    _lock_release(&meta_lock);
+    return request;
+}
+
+// store a metadata response
+bool avrc_meta_put(uint8_t attr, const uint8_t *text, size_t len)
+{
+    int i = avrc_meta_index(attr);
+    avrc_meta_text_t *t;
+    bool changed = false;
+
+    if (i < 0) {
+	return false;
+    }
+    _lock_acquire(&meta_lock);
+    t = &meta_text[i];
+    if (len != t->len || memcmp(&meta_arena[t->offset], text, len) != 0) {
+	// remove the old text
+	if (t->len > 0) {
+	    size_t end = t->offset + t->len;
+
+	    memmove(&meta_arena[t->offset], &meta_arena[end], meta_used - end);
+	    meta_used -= t->len;
+	    for (int k = 0; k < AVRC_META_ATTRS; k++) {
+		if (meta_text[k].len > 0 && meta_text[k].offset > t->offset) {
+		    meta_text[k].offset -= t->len;
+		}
+	    }
+	}
+	// append the new one
+	if (len > AVRC_META_ARENA - meta_used) {
+	    len = AVRC_META_ARENA - meta_used;
+	    while (len > 0 && (text[len] & 0xc0) == 0x80) {
+		len--;
+	    }
+	}
+	memcpy(&meta_arena[meta_used], text, len);
+	t->offset = meta_used;
+	t->len = len;
+	meta_used += len;
+	meta_changed |= attr;
+	changed = true;
+    }
+    meta_valid |= attr;
+    meta_pending &= ~attr;
+    _lock_release(&meta_lock);
+    return changed;
+}
+
+// take the attributes changed since the last call
+uint8_t avrc_meta_take_changed(void)
+{
+    uint8_t changed;
+
+    _lock_acquire(&meta_lock);
+    changed = meta_changed;
+    meta_changed = 0;
+    _lock_release(&meta_lock);
+    return changed;
+}
+
+// track number
+uint32_t avrc_meta_get_track(void)
+{
+    return meta_track;
+}
+
+// attributes known for the current track
+uint8_t avrc_meta_get_valid(void)
+{
+    return meta_valid;
+}
+
+// get the text of an attribute
+size_t avrc_meta_get(uint8_t attr, char *buf, size_t size)
+{
+    int i = avrc_meta_index(attr);
+    size_t len = 0;
+
+    if (size == 0) {
+	return 0;
+    }
+    _lock_acquire(&meta_lock);
+    if (i >= 0 && (meta_valid & attr)) {
+	len = meta_text[i].len;
+	if (len > size - 1) {
+	    len = size - 1;
+	    while (len > 0 && (meta_arena[meta_text[i].offset + len] & 0xc0) == 0x80) {
+		len--;
+	    }
+	}
+	memcpy(buf, &meta_arena[meta_text[i].offset], len);
+    }
+    buf[len] = 0;
+    _lock_release(&meta_lock);
+    return len;
+}
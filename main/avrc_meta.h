@@ -0,0 +1,83 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __AVRC_META_H__
+#define __AVRC_META_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Cache of the AVRCP metadata of the playing track. The texts are kept
+ * in one fixed arena, a response is stored only when its text differs
+ * from the cached one, and metadata is requested only for attributes
+ * that are neither known nor requested for the current track. The BT
+ * callback stores responses in place, any task may query the cache.
+ */
+
+// attributes, bit masks as ESP_AVRC_MD_ATTR_*
+#define AVRC_META_TITLE		0x01
+#define AVRC_META_ARTIST	0x02
+#define AVRC_META_ALBUM		0x04
+#define AVRC_META_TRACK_NUM	0x08
+#define AVRC_META_NUM_TRACKS	0x10
+#define AVRC_META_GENRE		0x20
+#define AVRC_META_PLAYING_TIME	0x40
+#define AVRC_META_ATTRS		7
+
+#define AVRC_META_UID_SIZE	8
+#define AVRC_META_PENDING_MS	2000	// a request not answered by then is sent again
+
+/*
+ * forget the track and the texts, on disconnection
+ */
+void avrc_meta_reset(void);
+
+/*
+ * track changed notification (or first request after connection)
+ *   uid: track UID of the notification, NULL without notification (the
+ *        same track). 0 (track selected, no browsing) and all 1s (none
+ *        selected) do not identify a track, every notification with
+ *        these is a new track.
+ *   attrs: attributes wanted
+ *   now_ms: current time in ms
+ *   return: attributes to request, 0 when all are known or requested
+ */
+uint8_t avrc_meta_track_changed(const uint8_t *uid, uint8_t attrs, uint32_t now_ms);
+
+/*
+ * store a metadata response, called by the BT callback
+ *   attr: one AVRC_META_* attribute
+ *   text: UTF-8 text, not terminated
+ *   return: true when the text changed
+ */
+bool avrc_meta_put(uint8_t attr, const uint8_t *text, size_t len);
+
+/*
+ * take the attributes changed since the last call
+ */
+uint8_t avrc_meta_take_changed(void);
+
+/*
+ * track number, counts track changes, to poll for a new track
+ */
+uint32_t avrc_meta_get_track(void);
+
+/*
+ * attributes known for the current track
+ */
+uint8_t avrc_meta_get_valid(void);
+
+/*
+ * get the text of an attribute
+ *   buf: terminated text, truncated to size - 1 bytes
+ *   return: text length, 0 when not known
+ */
+size_t avrc_meta_get(uint8_t attr, char *buf, size_t size);
+
+#endif /* __AVRC_META_H__ */
@@ -26,10 +26,26 @@
 #include "driver/i2s.h"
 
 #include "sys/lock.h"
+#include "nvs.h"
 
 #ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
 #include "spdif.h"
 #endif
+#ifdef CONFIG_SPDIF_DSP
+#include "dsp.h"
+#endif
+#ifdef CONFIG_SPDIF_FIXED_RATE
+#include "resample.h"
+#endif
+#ifdef CONFIG_SPDIF_UPSAMPLE
+#include "upsample.h"
+#endif
+#ifdef CONFIG_SPDIF_DFS
+#include "dfs.h"
+#endif
+#ifdef CONFIG_EXAMPLE_AVRC_META_CACHE
+#include "avrc_meta.h"
+#endif
 
 // AVRCP used transaction label
 #define APP_RC_CT_TL_GET_CAPS            (0)
@@ -47,6 +63,9 @@ static void bt_av_hdl_avrc_tg_evt(uint16_t event, void *p_param);
 
 static uint32_t s_pkt_cnt = 0;
 static esp_a2d_audio_state_t s_audio_state = ESP_A2D_AUDIO_STATE_STOPPED;
+#ifdef CONFIG_SPDIF_SYNC
+static int s_sample_rate = 44100;
+#endif
 static const char *s_a2d_conn_state_str[] = {"Disconnected", "Connecting", "Connected", "Disconnecting"};
 static const char *s_a2d_audio_state_str[] = {"Suspended", "Stopped", "Started"};
 static esp_avrc_rn_evt_cap_mask_t s_avrc_peer_rn_cap;
@@ -59,6 +78,65 @@ uint8_t s_volume = 0;
 #endif
 static bool s_volume_notify;
 
+#define BT_AV_NVS_NAMESPACE "bt_av"
+#define BT_AV_NVS_LAST_BDA  "last_bda"
+
+/* remember the connected source for reconnection at boot */
+static void bt_av_save_last_bda(const esp_bd_addr_t bda)
+{
+    nvs_handle handle;
+    esp_bd_addr_t last;
+    size_t size = sizeof(last);
+
+    if (nvs_open(BT_AV_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    // write only when changed, to save flash wear
+    if (nvs_get_blob(handle, BT_AV_NVS_LAST_BDA, last, &size) != ESP_OK ||
+        memcmp(last, bda, ESP_BD_ADDR_LEN) != 0) {
+        nvs_set_blob(handle, BT_AV_NVS_LAST_BDA, bda, ESP_BD_ADDR_LEN);
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+bool bt_app_av_reconnect(void)
+{
+    nvs_handle handle;
+    esp_bd_addr_t bda;
+    size_t size = sizeof(bda);
+    bool bonded = false;
+
+    if (nvs_open(BT_AV_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(handle, BT_AV_NVS_LAST_BDA, bda, &size);
+    nvs_close(handle);
+    if (err != ESP_OK || size != sizeof(bda)) {
+        return false;
+    }
+
+    // the link key may have been removed since
+    int num = esp_bt_gap_get_bond_device_num();
+    esp_bd_addr_t *list = (num > 0) ? malloc(num * sizeof(esp_bd_addr_t)) : NULL;
+    if (list && esp_bt_gap_get_bond_device_list(&num, list) == ESP_OK) {
+        for (int i = 0; i < num; i++) {
+            if (memcmp(list[i], bda, ESP_BD_ADDR_LEN) == 0) {
+                bonded = true;
+                break;
+            }
+        }
+    }
+    free(list);
+    if (!bonded) {
+        return false;
+    }
+
+    ESP_LOGI(BT_AV_TAG, "Reconnecting to [%02x:%02x:%02x:%02x:%02x:%02x]",
+             bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+    return esp_a2d_sink_connect(bda) == ESP_OK;
+}
+
 /* callback for A2DP sink */
 void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
 {
@@ -78,11 +156,15 @@ void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
 void bt_app_a2d_data_cb(const uint8_t *data, uint32_t len)
 {
     write_ringbuf(data, len);
+    if (s_pkt_cnt == 0) {
+        bt_app_boot_end("first audio packet");
+    }
     if (++s_pkt_cnt % 100 == 0) {
         ESP_LOGI(BT_AV_TAG, "Audio packet count %u", s_pkt_cnt);
     }
 }
 
+#ifndef CONFIG_EXAMPLE_AVRC_META_CACHE
 void bt_app_alloc_meta_buffer(esp_avrc_ct_cb_param_t *param)
 {
     esp_avrc_ct_cb_param_t *rc = (esp_avrc_ct_cb_param_t *)(param);
@@ -92,13 +174,23 @@ void bt_app_alloc_meta_buffer(esp_avrc_ct_cb_param_t *param)
 
     rc->meta_rsp.attr_text = attr_text;
 }
+#endif
 
 void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param)
 {
     switch (event) {
+#ifdef CONFIG_EXAMPLE_AVRC_META_CACHE
+    case ESP_AVRC_CT_METADATA_RSP_EVT:
+        // store in the cache, the app task is told only about changes
+        if (avrc_meta_put(param->meta_rsp.attr_id, param->meta_rsp.attr_text, param->meta_rsp.attr_length)) {
+            bt_app_work_dispatch(bt_av_hdl_avrc_ct_evt, event, NULL, 0, NULL);
+        }
+        break;
+#else
     case ESP_AVRC_CT_METADATA_RSP_EVT:
         bt_app_alloc_meta_buffer(param);
         /* fall through */
+#endif
     case ESP_AVRC_CT_CONNECTION_STATE_EVT:
     case ESP_AVRC_CT_PASSTHROUGH_RSP_EVT:
     case ESP_AVRC_CT_CHANGE_NOTIFY_EVT:
@@ -145,6 +237,8 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         } else if (a2d->conn_stat.state == ESP_A2D_CONNECTION_STATE_CONNECTED){
             esp_bt_gap_set_scan_mode(ESP_BT_NON_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
             bt_i2s_task_start_up();
+            bt_app_boot_mark("A2DP connected");
+            bt_av_save_last_bda(bda);
         }
         break;
     }
@@ -155,6 +249,13 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         if (ESP_A2D_AUDIO_STATE_STARTED == a2d->audio_stat.state) {
             s_pkt_cnt = 0;
         }
+#ifdef CONFIG_SPDIF_SYNC
+        // the stream position counts from the start on every sink
+        bt_i2s_sync_stream(ESP_A2D_AUDIO_STATE_STARTED == a2d->audio_stat.state ? s_sample_rate : 0);
+#endif
+#ifdef CONFIG_SPDIF_PLC
+        bt_i2s_plc_stream(ESP_A2D_AUDIO_STATE_STARTED == a2d->audio_stat.state);
+#endif
         break;
     }
     case ESP_A2D_AUDIO_CFG_EVT: {
@@ -171,10 +272,38 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
             } else if (oct0 & (0x01 << 4)) {
                 sample_rate = 48000;
             }
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
-	    spdif_set_sample_rates(sample_rate);
+            int out_rate = sample_rate;
+#ifdef CONFIG_SPDIF_UPSAMPLE
+            // 16kHz and 32kHz are converted to 48kHz, mono is stereo unless decoded to one channel
+            int channels = 2;
+#ifdef CONFIG_SPDIF_UPSAMPLE_MONO
+            if (oct0 & (0x01 << 3)) {
+                channels = 1;
+            }
+#endif
+            out_rate = upsample_set_format(sample_rate, channels);
+            if (out_rate != sample_rate || channels == 1) {
+                ESP_LOGI(BT_AV_TAG, "Converting %dHz %s to %dHz stereo", sample_rate,
+                         channels == 1 ? "mono" : "stereo", out_rate);
+            }
+#endif
+#ifdef CONFIG_SPDIF_FIXED_RATE
+            // S/PDIF output rate is fixed, convert the stream to it
+            spdif_set_mute(true, true);
+            resample_set_rates(out_rate, CONFIG_SPDIF_FIXED_RATE_HZ);
+            spdif_set_mute(false, false);
+            out_rate = CONFIG_SPDIF_FIXED_RATE_HZ;
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF)
+	    spdif_set_sample_rates(out_rate);
 #else
-            i2s_set_clk(0, sample_rate, 16, 2);
+            i2s_set_clk(0, out_rate, 16, 2);
+#endif
+#ifdef CONFIG_SPDIF_DSP
+            // DSP runs at S/PDIF output rate
+            dsp_set_rate(out_rate);
+#endif
+#ifdef CONFIG_SPDIF_DFS
+            dfs_set_rate(out_rate);
 #endif
 
             ESP_LOGI(BT_AV_TAG, "Configure audio player %x-%x-%x-%x",
@@ -182,6 +311,9 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
                      a2d->audio_cfg.mcc.cie.sbc[1],
                      a2d->audio_cfg.mcc.cie.sbc[2],
                      a2d->audio_cfg.mcc.cie.sbc[3]);
+#ifdef CONFIG_SPDIF_SYNC
+            s_sample_rate = sample_rate;
+#endif
             ESP_LOGI(BT_AV_TAG, "Audio player configured, sample rate=%d", sample_rate);
         }
         break;
@@ -192,11 +324,19 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
     }
 }
 
-static void bt_av_new_track(void)
+static void bt_av_new_track(const uint8_t *uid)
 {
     // request metadata
     uint8_t attr_mask = ESP_AVRC_MD_ATTR_TITLE | ESP_AVRC_MD_ATTR_ARTIST | ESP_AVRC_MD_ATTR_ALBUM | ESP_AVRC_MD_ATTR_GENRE;
+#ifdef CONFIG_EXAMPLE_AVRC_META_CACHE
+    // only what is neither cached for this track nor already requested
+    attr_mask = avrc_meta_track_changed(uid, attr_mask, xTaskGetTickCount() * portTICK_PERIOD_MS);
+    if (attr_mask) {
+        esp_avrc_ct_send_metadata_cmd(APP_RC_CT_TL_GET_META_DATA, attr_mask);
+    }
+#else
     esp_avrc_ct_send_metadata_cmd(APP_RC_CT_TL_GET_META_DATA, attr_mask);
+#endif
 
     // register notification if peer support the event_id
     if (esp_avrc_rn_evt_bit_mask_operation(ESP_AVRC_BIT_MASK_OP_TEST, &s_avrc_peer_rn_cap,
@@ -225,7 +365,7 @@ void bt_av_notify_evt_handler(uint8_t event_id, esp_avrc_rn_param_t *event_param
 {
     switch (event_id) {
     case ESP_AVRC_RN_TRACK_CHANGE:
-        bt_av_new_track();
+        bt_av_new_track(event_parameter->elm_id);
         break;
     case ESP_AVRC_RN_PLAY_STATUS_CHANGE:
         ESP_LOGI(BT_AV_TAG, "Playback status changed: 0x%x", event_parameter->playback);
@@ -254,6 +394,9 @@ static void bt_av_hdl_avrc_ct_evt(uint16_t event, void *p_param)
         } else {
             // clear peer notification capability record
             s_avrc_peer_rn_cap.bits = 0;
+#ifdef CONFIG_EXAMPLE_AVRC_META_CACHE
+            avrc_meta_reset();
+#endif
         }
         break;
     }
@@ -262,8 +405,21 @@ static void bt_av_hdl_avrc_ct_evt(uint16_t event, void *p_param)
         break;
     }
     case ESP_AVRC_CT_METADATA_RSP_EVT: {
+#ifdef CONFIG_EXAMPLE_AVRC_META_CACHE
+        // no parameter, log what changed since the last event
+        uint8_t changed = avrc_meta_take_changed();
+        char text[64];
+
+        for (int i = 0; i < AVRC_META_ATTRS; i++) {
+            if (changed & (1 << i)) {
+                avrc_meta_get(1 << i, text, sizeof(text));
+                ESP_LOGI(BT_RC_CT_TAG, "AVRC metadata changed: attribute id 0x%x, %s", 1 << i, text);
+            }
+        }
+#else
         ESP_LOGI(BT_RC_CT_TAG, "AVRC metadata rsp: attribute id 0x%x, %s", rc->meta_rsp.attr_id, rc->meta_rsp.attr_text);
         free(rc->meta_rsp.attr_text);
+#endif
         break;
     }
     case ESP_AVRC_CT_CHANGE_NOTIFY_EVT: {
@@ -279,7 +435,7 @@ static void bt_av_hdl_avrc_ct_evt(uint16_t event, void *p_param)
         ESP_LOGI(BT_RC_CT_TAG, "remote rn_cap: count %d, bitmask 0x%x", rc->get_rn_caps_rsp.cap_count,
                  rc->get_rn_caps_rsp.evt_set.bits);
         s_avrc_peer_rn_cap.bits = rc->get_rn_caps_rsp.evt_set.bits;
-        bt_av_new_track();
+        bt_av_new_track(NULL);
         bt_av_playback_changed();
         bt_av_play_pos_changed();
         break;
@@ -296,6 +452,9 @@ static void volume_set_by_controller(uint8_t volume)
     _lock_acquire(&s_volume_lock);
     s_volume = volume;
     _lock_release(&s_volume_lock);
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+    spdif_set_gain(volume < 100 ? volume * SPDIF_GAIN_UNITY / 100 : SPDIF_GAIN_UNITY);
+#endif
 }
 
 #ifndef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
@@ -37,4 +37,7 @@ void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param
  */
 void bt_app_rc_tg_cb(esp_avrc_tg_cb_event_t event, esp_avrc_tg_cb_param_t *param);
 
+/* connect to the last connected source if it is still bonded */
+bool bt_app_av_reconnect(void);
+
 #endif /* __BT_APP_AV_H__*/
@@ -15,12 +15,37 @@
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "bt_app_core.h"
 #include "driver/i2s.h"
 #include "freertos/ringbuf.h"
 
 #ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
 #include "spdif.h"
+#include "spdif_enc.h"
+#endif
+#ifdef CONFIG_SPDIF_FLASH_STRESS
+#include "nvs.h"
+#endif
+#ifdef CONFIG_SPDIF_FIXED_RATE
+#include "resample.h"
+#endif
+#ifdef CONFIG_SPDIF_UPSAMPLE
+#include "upsample.h"
+#endif
+#ifdef CONFIG_SPDIF_PLC
+#include "plc.h"
+#endif
+#ifdef CONFIG_SPDIF_DSP
+#include "dsp.h"
+#endif
+#ifdef CONFIG_SPDIF_DFS
+#include "dfs.h"
+#endif
+#ifdef CONFIG_SPDIF_SYNC
+#include "sync.h"
 #endif
 
 static void bt_app_task_handler(void *arg);
@@ -31,8 +56,33 @@ static xQueueHandle s_bt_app_task_queue = NULL;
 static xTaskHandle s_bt_app_task_handle = NULL;
 static xTaskHandle s_bt_i2s_task_handle = NULL;
 static RingbufHandle_t s_ringbuf_i2s = NULL;;
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+static volatile bool s_bt_i2s_task_stop = false;
+#endif
 
+#ifdef CONFIG_EXAMPLE_RINGBUF_SIZE
+#define RINGBUF_SIZE (CONFIG_EXAMPLE_RINGBUF_SIZE & ~3)	// whole frames, items do not split one
+#else
 #define RINGBUF_SIZE (16 * 1024)
+#endif
+#ifdef CONFIG_EXAMPLE_APP_TASK_STACK
+#define BT_APP_TASK_STACK CONFIG_EXAMPLE_APP_TASK_STACK
+#else
+#define BT_APP_TASK_STACK 3072
+#endif
+#ifdef CONFIG_EXAMPLE_I2S_TASK_STACK
+#define BT_I2S_TASK_STACK CONFIG_EXAMPLE_I2S_TASK_STACK
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF)
+#define BT_I2S_TASK_STACK 2048
+#else
+#define BT_I2S_TASK_STACK 1024
+#endif
+#define AUDIO_SAMPLE_SIZE (16 * 2 / 8) // 16bit, 2ch, 8bit/byte
+
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+static size_t s_ringbuf_peak;                   // most bytes in the ring buffer
+static UBaseType_t s_bt_i2s_stack_unused;       // high-water mark of the last I2S task
+#endif
 
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback)
 {
@@ -106,7 +156,7 @@ static void bt_app_task_handler(void *arg)
 void bt_app_task_start_up(void)
 {
     s_bt_app_task_queue = xQueueCreate(10, sizeof(bt_app_msg_t));
-    xTaskCreate(bt_app_task_handler, "BtAppT", 3072, NULL, configMAX_PRIORITIES - 3, &s_bt_app_task_handle);
+    xTaskCreate(bt_app_task_handler, "BtAppT", BT_APP_TASK_STACK, NULL, configMAX_PRIORITIES - 3, &s_bt_app_task_handle);
     return;
 }
 
@@ -122,6 +172,217 @@ void bt_app_task_shut_down(void)
     }
 }
 
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+// write audio data at S/PDIF output rate
+static void bt_i2s_spdif_write(int16_t *audio, size_t size)
+{
+#ifdef CONFIG_SPDIF_DSP
+    dsp_process(audio, size / AUDIO_SAMPLE_SIZE);
+#endif
+#ifdef CONFIG_SPDIF_PLC
+    plc_update(audio, size / AUDIO_SAMPLE_SIZE);
+#endif
+    spdif_write(audio, size);
+}
+#endif
+
+#ifdef CONFIG_SPDIF_PLC
+#define PLC_BLOCK_FRAMES 96 // half of S/PDIF block
+
+static int16_t s_plc_buf[PLC_BLOCK_FRAMES * 2];
+static volatile bool s_plc_stream_started;
+
+void bt_i2s_plc_stream(bool started)
+{
+    s_plc_stream_started = started;
+}
+#endif
+
+#ifdef CONFIG_SPDIF_FIXED_RATE
+#define RESAMPLE_BUF_FRAMES 256
+
+static int16_t s_resample_buf[RESAMPLE_BUF_FRAMES * 2];
+
+// convert audio data to the fixed S/PDIF sample rate and write it
+static void spdif_write_resampled(const int16_t *audio, size_t size)
+{
+    size_t frames = size / AUDIO_SAMPLE_SIZE;
+
+    while (frames > 0) {
+        size_t n = frames;
+        size_t out = resample_process(audio, &n, s_resample_buf, RESAMPLE_BUF_FRAMES);
+
+        bt_i2s_spdif_write(s_resample_buf, out * AUDIO_SAMPLE_SIZE);
+        audio += n * 2;
+        frames -= n;
+    }
+}
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+// write stereo audio data at stream rate or at the rate converted to
+static void bt_i2s_stereo_write(int16_t *audio, size_t size)
+{
+#ifdef CONFIG_SPDIF_FIXED_RATE
+    spdif_write_resampled(audio, size);
+#else
+    bt_i2s_spdif_write(audio, size);
+#endif
+}
+#endif
+
+#ifdef CONFIG_SPDIF_UPSAMPLE
+#define UPSAMPLE_BUF_FRAMES 192
+#define STREAM_FRAME_SIZE (upsample_get_channels() * 2) // 16bit, 1 or 2ch
+
+static int16_t s_upsample_buf[UPSAMPLE_BUF_FRAMES * 2];
+#else
+#define STREAM_FRAME_SIZE AUDIO_SAMPLE_SIZE
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+// write audio data at stream rate
+static void bt_i2s_stream_write(int16_t *audio, size_t size)
+{
+#ifdef CONFIG_SPDIF_UPSAMPLE
+    if (upsample_active()) {
+        // low rate or mono stream, convert to stereo at 48kHz first
+        int channels = upsample_get_channels();
+        size_t frames = size / STREAM_FRAME_SIZE;
+
+        while (frames > 0) {
+            size_t n = frames;
+            size_t out = upsample_process(audio, &n, s_upsample_buf, UPSAMPLE_BUF_FRAMES);
+
+            bt_i2s_stereo_write(s_upsample_buf, out * AUDIO_SAMPLE_SIZE);
+            audio += n * channels;
+            frames -= n;
+        }
+        return;
+    }
+#endif
+    bt_i2s_stereo_write(audio, size);
+}
+#endif
+
+#ifdef CONFIG_SPDIF_SYNC
+static volatile int s_sync_rate;	// stream rate, 0 while stopped
+static int s_sync_running;		// stream rate known by sync_playout()
+static int16_t s_sync_buf[SYNC_MAX_INSERT * 2];
+
+void bt_i2s_sync_stream(int rate)
+{
+    s_sync_rate = rate;
+}
+
+// pass stream start and stop to the synchronization in the I2S task
+static void bt_i2s_sync_update(int rate)
+{
+    if (rate != s_sync_running) {
+	if (s_sync_running) {
+	    sync_stop();
+	}
+	if (rate) {
+	    sync_start(rate);
+	}
+	s_sync_running = rate;
+    }
+}
+
+// drop or insert frames before the item is written, return the remaining item size
+static size_t bt_i2s_sync_item(int16_t **audio, size_t size)
+{
+    size_t frame_size = STREAM_FRAME_SIZE;
+    int channels = frame_size / sizeof(int16_t);
+    size_t frames = size / frame_size;
+    UBaseType_t waiting;
+    int c;
+
+    vRingbufferGetInfo(s_ringbuf_i2s, NULL, NULL, NULL, NULL, &waiting);
+    c = sync_playout(spdif_get_playout_time(), frames, frames + waiting / frame_size,
+		     RINGBUF_SIZE / frame_size);
+    if (c > (int)frames) {
+	c = frames;	// cannot drop more than the item, e.g. less than a frame
+    }
+    if (c > 0) {
+	*audio += c * channels;
+	return size - c * frame_size;
+    }
+    if (c < 0) {
+	// repeat a single frame, fill up by silence
+	for (int i = 0; i < -c; i++) {
+	    for (int ch = 0; ch < channels; ch++) {
+		s_sync_buf[i * channels + ch] = c == -1 ? (*audio)[ch] : 0;
+	    }
+	}
+	bt_i2s_stream_write(s_sync_buf, -c * frame_size);
+    }
+    return size;
+}
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+static TickType_t s_spdif_last_audible;
+static bool s_spdif_idle;
+
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+static void bt_app_mem_report_hdl(uint16_t event, void *param)
+{
+    bt_app_mem_report();
+}
+
+// report on the application task, not on the I2S task stack, never block
+static void bt_i2s_mem_report(void)
+{
+    bt_app_msg_t msg;
+
+    memset(&msg, 0, sizeof(bt_app_msg_t));
+    msg.sig = BT_APP_SIG_WORK_DISPATCH;
+    msg.cb = bt_app_mem_report_hdl;
+    xQueueSend(s_bt_app_task_queue, &msg, 0);
+}
+#endif
+
+// enter idle mode after no audible data for the idle timeout
+static void bt_i2s_spdif_idle(bool audible)
+{
+    if (audible) {
+        if (s_spdif_idle) {
+            ESP_LOGI(BT_APP_CORE_TAG, "S/PDIF output active");
+            s_spdif_idle = false;
+#ifdef CONFIG_SPDIF_DFS
+            dfs_set_state(DFS_ACTIVE);
+#endif
+        }
+        s_spdif_last_audible = xTaskGetTickCount();
+    } else if (!s_spdif_idle &&
+               xTaskGetTickCount() - s_spdif_last_audible >= pdMS_TO_TICKS(CONFIG_SPDIF_IDLE_TIMEOUT_MS)) {
+        ESP_LOGI(BT_APP_CORE_TAG, "S/PDIF output idle");
+        s_spdif_idle = true;
+#ifdef CONFIG_SPDIF_DFS
+        dfs_set_state(DFS_IDLE);
+#endif
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+        bt_i2s_mem_report();
+#endif
+    }
+}
+#endif
+
+#ifdef CONFIG_SPDIF_LEVEL_METER
+// check whether the last written audio data is above the standby level
+static bool bt_i2s_spdif_audible(void)
+{
+    spdif_levels_t levels;
+
+    if (CONFIG_SPDIF_STANDBY_LEVEL == 0) {
+        return true;
+    }
+    spdif_get_levels(&levels);
+    return levels.peak[0] > CONFIG_SPDIF_STANDBY_LEVEL || levels.peak[1] > CONFIG_SPDIF_STANDBY_LEVEL;
+}
+#endif
+
 static void bt_i2s_task_handler(void *arg)
 {
     uint8_t *data = NULL;
@@ -129,12 +390,56 @@ static void bt_i2s_task_handler(void *arg)
 #ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
     extern uint8_t s_volume;
     s_volume = 100;		// initialize default volume
+    spdif_set_gain(SPDIF_GAIN_UNITY);
+
+    // start from silence, fade in with the first audio data
+    spdif_set_mute(true, false);
+    spdif_write_silence();
+    spdif_set_mute(false, false);
+    s_spdif_last_audible = xTaskGetTickCount();
+    s_spdif_idle = false;
+#ifdef CONFIG_SPDIF_DFS
+    dfs_set_state(DFS_ACTIVE);
+#endif
+#ifdef CONFIG_SPDIF_PLC
+    plc_reset();
+#endif
+#if defined(CONFIG_SPDIF_DSP) && CONFIG_SPDIF_DSP_HIGHPASS_HZ > 0
+    dsp_set_band(0, DSP_HIGHPASS, CONFIG_SPDIF_DSP_HIGHPASS_HZ, 0, 0.707f);
+#endif
 #else
     size_t bytes_written = 0;
 #endif
 
     for (;;) {
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+	if (s_bt_i2s_task_stop) {
+	    break;
+	}
+#ifdef CONFIG_SPDIF_SYNC
+	bt_i2s_sync_update(s_sync_rate);
+#endif
+	data = (uint8_t *)xRingbufferReceive(s_ringbuf_i2s, &item_size, 0);
+	if (data == NULL) {
+	    // no audio data, conceal the gap, then keep S/PDIF receiver locked by silence
+#ifdef CONFIG_SPDIF_PLC
+	    if (!s_plc_stream_started) {
+		plc_end();	// the source stopped sending, nothing was lost
+	    }
+	    if (plc_conceal(s_plc_buf, PLC_BLOCK_FRAMES)) {
+		spdif_write(s_plc_buf, sizeof(s_plc_buf));
+	    } else {
+		spdif_write_silence();
+	    }
+#else
+	    spdif_write_silence();
+#endif
+	    bt_i2s_spdif_idle(false);
+	    continue;
+	}
+#else
         data = (uint8_t *)xRingbufferReceive(s_ringbuf_i2s, &item_size, (portTickType)portMAX_DELAY);
+#endif
         if (item_size != 0){
 #ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
 	    uint16_t *dac = (uint16_t *)data;
@@ -145,22 +450,70 @@ static void bt_i2s_task_handler(void *arg)
 #endif
 #ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
 	    int16_t *audio = (int16_t *)data;
+	    size_t audio_size = item_size;
 
-	    if (s_volume < 100) {
-	    	for (int i = 0; i < item_size / sizeof(uint16_t); i++) {
-		    audio[i] = (audio[i] * s_volume) / 100;
-		}
+#ifdef CONFIG_SPDIF_SYNC
+	    audio_size = bt_i2s_sync_item(&audio, audio_size);
+#endif
+	    if (audio_size > 0) {
+		bt_i2s_stream_write(audio, audio_size);
 	    }
 
-	    spdif_write(data, item_size);
+#ifdef CONFIG_SPDIF_LEVEL_METER
+	    bt_i2s_spdif_idle(bt_i2s_spdif_audible());
+#else
+	    bt_i2s_spdif_idle(true);
+#endif
+#ifdef CONFIG_SPDIF_DFS
+	    dfs_update();
+#endif
 #else
             i2s_write(0, data, item_size, &bytes_written, portMAX_DELAY);
 #endif
             vRingbufferReturnItem(s_ringbuf_i2s,(void *)data);
         }
     }
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+    s_bt_i2s_stack_unused = uxTaskGetStackHighWaterMark(NULL);
+#endif
+#ifdef CONFIG_SPDIF_DFS
+    dfs_set_state(DFS_STOPPED);
+#endif
+#ifdef CONFIG_SPDIF_SYNC
+    bt_i2s_sync_update(0);
+#endif
+    s_bt_i2s_task_stop = false;
+    vTaskDelete(NULL);
+#endif
 }
 
+#ifdef CONFIG_SPDIF_FLASH_STRESS
+static xTaskHandle s_flash_stress_task_handle = NULL;
+
+// debug: write NVS while playing, the flash cache is off during each write
+static void bt_flash_stress_task_handler(void *arg)
+{
+    nvs_handle handle;
+    uint32_t count = 0;
+    uint32_t underruns = spdif_get_underruns();
+
+    if (nvs_open("spdif_stress", NVS_READWRITE, &handle) != ESP_OK) {
+        vTaskDelete(NULL);
+    }
+    for (;;) {
+        nvs_set_u32(handle, "count", count++);
+        nvs_commit(handle);
+        if (count % 100 == 0) {
+            ESP_LOGI(BT_APP_CORE_TAG, "flash stress: %u NVS writes, %u underruns",
+                     count, spdif_get_underruns() - underruns);
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SPDIF_FLASH_STRESS_INTERVAL_MS));
+    }
+}
+#endif
+
 void bt_i2s_task_start_up(void)
 {
     s_ringbuf_i2s = xRingbufferCreate(RINGBUF_SIZE, RINGBUF_TYPE_BYTEBUF);
@@ -168,10 +521,11 @@ void bt_i2s_task_start_up(void)
         return;
     }
 
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
-    xTaskCreate(bt_i2s_task_handler, "BtI2ST", 2048, NULL, configMAX_PRIORITIES - 3, &s_bt_i2s_task_handle);
-#else
-    xTaskCreate(bt_i2s_task_handler, "BtI2ST", 1024, NULL, configMAX_PRIORITIES - 3, &s_bt_i2s_task_handle);
+    xTaskCreate(bt_i2s_task_handler, "BtI2ST", BT_I2S_TASK_STACK, NULL, configMAX_PRIORITIES - 3, &s_bt_i2s_task_handle);
+#ifdef CONFIG_SPDIF_FLASH_STRESS
+    if (s_flash_stress_task_handle == NULL) {
+        xTaskCreate(bt_flash_stress_task_handler, "FlashStressT", 2048, NULL, 5, &s_flash_stress_task_handle);
+    }
 #endif
     return;
 }
@@ -179,8 +533,23 @@ void bt_i2s_task_start_up(void)
 void bt_i2s_task_shut_down(void)
 {
     if (s_bt_i2s_task_handle) {
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+        // fade out, then let the task finish its S/PDIF write and exit by itself
+        spdif_set_mute(true, true);
+        s_bt_i2s_task_stop = true;
+        while (s_bt_i2s_task_stop) {
+            vTaskDelay(1);
+        }
+#else
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+        s_bt_i2s_stack_unused = uxTaskGetStackHighWaterMark(s_bt_i2s_task_handle);
+#endif
         vTaskDelete(s_bt_i2s_task_handle);
+#endif
         s_bt_i2s_task_handle = NULL;
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+        bt_app_mem_report();
+#endif
     }
 
     if (s_ringbuf_i2s) {
@@ -189,18 +558,60 @@ void bt_i2s_task_shut_down(void)
     }
 }
 
-#define AUDIO_SAMPLE_SIZE (16 * 2 / 8) // 16bit, 2ch, 8bit/byte
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+void bt_app_mem_report(void)
+{
+    ESP_LOGI(BT_APP_CORE_TAG, "mem: heap free %u, minimum %u, largest block %u",
+             esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+    if (s_bt_app_task_handle) {
+        ESP_LOGI(BT_APP_CORE_TAG, "mem: BtAppT stack %u, unused %u", BT_APP_TASK_STACK,
+                 uxTaskGetStackHighWaterMark(s_bt_app_task_handle));
+    }
+    ESP_LOGI(BT_APP_CORE_TAG, "mem: BtI2ST stack %u, unused %u", BT_I2S_TASK_STACK,
+             s_bt_i2s_task_handle ? uxTaskGetStackHighWaterMark(s_bt_i2s_task_handle) : s_bt_i2s_stack_unused);
+    ESP_LOGI(BT_APP_CORE_TAG, "mem: ring buffer %u, peak %u", RINGBUF_SIZE, (unsigned)s_ringbuf_peak);
+}
+#endif
+
+static int64_t s_boot_last_us;
+static bool s_boot_done;
+
+void bt_app_boot_mark(const char *phase)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (s_boot_done) {
+        return;
+    }
+    ESP_LOGI(BT_APP_CORE_TAG, "boot: %-24s %6d ms (+%d ms)", phase,
+             (int)(now / 1000), (int)((now - s_boot_last_us) / 1000));
+    s_boot_last_us = now;
+}
+
+void bt_app_boot_end(const char *phase)
+{
+    bt_app_boot_mark(phase);
+    s_boot_done = true;
+}
 
 size_t write_ringbuf(const uint8_t *data, size_t size)
 {
     // rate control
     UBaseType_t items;
     vRingbufferGetInfo(s_ringbuf_i2s, NULL, NULL, NULL, NULL, &items);
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+    if (items + size > s_ringbuf_peak) {
+        s_ringbuf_peak = items + size;
+    }
+#endif
+#ifndef CONFIG_SPDIF_SYNC	// the I2S task keeps the level, also a slave's, see sync_playout()
     if (items < RINGBUF_SIZE * 3 / 8) {
         xRingbufferSend(s_ringbuf_i2s, (void *)data, AUDIO_SAMPLE_SIZE, (portTickType)portMAX_DELAY);
     } else if (items > RINGBUF_SIZE * 5 / 8) {
         size -= AUDIO_SAMPLE_SIZE;
     }
+#endif
 
     BaseType_t done = xRingbufferSend(s_ringbuf_i2s, (void *)data, size, (portTickType)portMAX_DELAY);
     if(done){
@@ -50,4 +50,19 @@ void bt_i2s_task_shut_down(void);
 
 size_t write_ringbuf(const uint8_t *data, size_t size);
 
+/* start (stream sample rate) or stop (0) the synchronized stream position */
+void bt_i2s_sync_stream(int rate);
+
+/* A2DP stream started or suspended, an empty ring buffer is no gap after the end */
+void bt_i2s_plc_stream(bool started);
+
+/* log free heap, stack high-water marks and ring buffer peak */
+void bt_app_mem_report(void);
+
+/* log a boot phase with the time since boot and since the previous phase */
+void bt_app_boot_mark(const char *phase);
+
+/* log the last boot phase and the total boot time, later marks are ignored */
+void bt_app_boot_end(const char *phase);
+
 #endif /* __BT_APP_CORE_H__ */
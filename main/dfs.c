@@ -0,0 +1,161 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "soc/rtc.h"
+#include "spdif.h"
+#include "dfs.h"
+
+/*
+ * The S/PDIF clock comes from the APLL, which does not change with the
+ * CPU frequency. A CPU_FREQ_MAX lock only forces the configured maximum,
+ * and with a 240MHz maximum the APB_MAX mode runs the CPU at 240MHz too,
+ * so locks alone give no lower step. While audio is played the maximum
+ * is set to the lowest of 80, 160 and 240MHz leaving the headroom, and a
+ * CPU_FREQ_MAX lock holds it. ESP-IDF applies a new configuration at the
+ * next mode switch, so the lock is released and taken again around it.
+ * When the output goes idle or stops, all locks are released and the
+ * PM_DFS_INIT_AUTO configuration (maximum ESP32_DEFAULT_CPU_FREQ_MHZ,
+ * minimum XTAL) is restored, the CPU may then drop to the minimum.
+ */
+#define DFS_TAG			"DFS"
+#define DFS_PERIOD_US		(1000 * 1000)	// reselection period
+#define DFS_DOWN_PERIODS	5		// low load periods before stepping down
+
+#ifdef CONFIG_SPDIF_DFS_HEADROOM
+#define DFS_HEADROOM		CONFIG_SPDIF_DFS_HEADROOM
+#else
+#define DFS_HEADROOM		60
+#endif
+
+#ifdef CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#define DFS_MAX_MHZ		CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ	// maximum of PM_DFS_INIT_AUTO
+#else
+#define DFS_MAX_MHZ		240
+#endif
+
+static const int dfs_mhz[] = { 80, 160, 240 };
+#define DFS_STEPS		(sizeof(dfs_mhz) / sizeof(dfs_mhz[0]))
+
+static esp_pm_lock_handle_t dfs_cpu_lock;	// held while audio is played
+static bool dfs_ready;
+static dfs_state_t dfs_state = DFS_STOPPED;
+static int dfs_top;				// highest step up to DFS_MAX_MHZ
+static int dfs_step;
+static int dfs_down;
+static int dfs_rate = 44100;
+static int64_t dfs_last_us;
+
+// set the maximum frequency, the minimum stays XTAL
+static esp_err_t dfs_configure(int mhz)
+{
+    esp_pm_config_esp32_t config = {
+	.max_freq_mhz = mhz,
+	.min_freq_mhz = rtc_clk_xtal_freq_get(),
+	.light_sleep_enable = false,
+    };
+
+    return esp_pm_configure(&config);
+}
+
+// run at the selected step, the lock makes ESP-IDF switch to it
+static void dfs_select(void)
+{
+    esp_pm_lock_release(dfs_cpu_lock);
+    dfs_configure(dfs_mhz[dfs_step]);
+    esp_pm_lock_acquire(dfs_cpu_lock);
+}
+
+// set up dynamic frequency scaling
+void dfs_init(void)
+{
+    esp_err_t err;
+
+    if ((err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "spdif_cpu", &dfs_cpu_lock)) != ESP_OK) {
+	ESP_LOGE(DFS_TAG, "power management not available: %s", esp_err_to_name(err));
+	return;
+    }
+    while (dfs_top < DFS_STEPS - 1 && dfs_mhz[dfs_top + 1] <= DFS_MAX_MHZ) {
+	dfs_top++;
+    }
+    dfs_step = dfs_top;		// maximum until measured
+    dfs_ready = true;
+}
+
+// set output sampling rate
+void dfs_set_rate(int rate)
+{
+    dfs_rate = rate;
+}
+
+// set output state
+void dfs_set_state(dfs_state_t state)
+{
+    if (!dfs_ready || state == dfs_state) {
+	return;
+    }
+    if (state == DFS_ACTIVE) {
+	dfs_configure(dfs_mhz[dfs_step]);
+	esp_pm_lock_acquire(dfs_cpu_lock);
+	dfs_last_us = esp_timer_get_time();
+	dfs_down = 0;
+    } else if (dfs_state == DFS_ACTIVE) {
+	esp_pm_lock_release(dfs_cpu_lock);
+	dfs_configure(DFS_MAX_MHZ);
+    }
+    dfs_state = state;
+}
+
+// select the lowest frequency leaving the headroom
+void dfs_update(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t cycles;
+    int need, step = 0;
+
+    if (!dfs_ready || dfs_state != DFS_ACTIVE || now - dfs_last_us < DFS_PERIOD_US) {
+	return;
+    }
+    dfs_last_us = now;
+    if ((cycles = spdif_get_cycles_per_frame()) == 0) {
+	return;
+    }
+
+    // MHz needed by the audio task
+    need = (uint64_t)cycles * dfs_rate / 1000000;
+    while (step < dfs_top && need * 100 > dfs_mhz[step] * (100 - DFS_HEADROOM)) {
+	step++;
+    }
+    ESP_LOGD(DFS_TAG, "%u cycles/frame at %dHz, %d MHz needed, headroom %d%% at %d MHz",
+	     cycles, dfs_rate, need, 100 - need * 100 / dfs_mhz[dfs_step], dfs_mhz[dfs_step]);
+
+    // step up at once, step down after a while
+    if (step >= dfs_step) {
+	dfs_down = 0;
+    } else if (++dfs_down < DFS_DOWN_PERIODS) {
+	return;
+    }
+    if (step == dfs_step) {
+	return;
+    }
+    ESP_LOGI(DFS_TAG, "CPU %d -> %d MHz, %u cycles/frame at %dHz, headroom %d%% -> %d%%",
+	     dfs_mhz[dfs_step], dfs_mhz[step], cycles, dfs_rate,
+	     100 - need * 100 / dfs_mhz[dfs_step], 100 - need * 100 / dfs_mhz[step]);
+    dfs_step = step;
+    dfs_down = 0;
+    dfs_select();
+}
+
+// CPU frequency selected for playback
+int dfs_get_mhz(void)
+{
+    return dfs_mhz[dfs_step];
+}
@@ -0,0 +1,48 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __DFS_H__
+#define __DFS_H__
+
+typedef enum {
+    DFS_STOPPED = 0,	// no output, no lock
+    DFS_IDLE,		// silence is sent, no lock
+    DFS_ACTIVE,		// audio is played, selected frequency
+} dfs_state_t;
+
+/*
+ * set up dynamic frequency scaling, needs CONFIG_PM_ENABLE
+ *   while audio is played the maximum frequency is set to the lowest of
+ *   80, 160 and 240MHz leaving the headroom and held by a CPU_FREQ_MAX
+ *   lock, otherwise no lock is held and the PM_DFS_INIT_AUTO
+ *   configuration applies
+ */
+void dfs_init(void);
+
+/*
+ * set output sampling rate used for the load calculation
+ *   rate: sampling rate, 44100Hz, 48000Hz etc.
+ */
+void dfs_set_rate(int rate);
+
+/*
+ * set output state, called by the audio task
+ *   state: DFS_STOPPED, DFS_IDLE or DFS_ACTIVE
+ */
+void dfs_set_state(dfs_state_t state);
+
+/*
+ * reselect the CPU frequency about once a second, called by the audio task
+ */
+void dfs_update(void);
+
+/*
+ * CPU frequency selected for playback in MHz
+ */
+int dfs_get_mhz(void);
+
+#endif /* __DFS_H__ */
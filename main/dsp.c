@@ -0,0 +1,326 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "dsp.h"
+
+#ifdef ESP_PLATFORM
+#include "sys/lock.h"
+#include "xtensa/hal.h"
+#define dsp_ccount()		xthal_get_ccount()
+#else
+typedef int _lock_t;
+#define _lock_acquire(l)	((void)(l))
+#define _lock_release(l)	((void)(l))
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define dsp_ccount()		((uint32_t)__rdtsc())	// TSC, nominal clock cycles
+#else
+#define dsp_ccount()		0
+#endif
+#endif
+
+/*
+ * Direct form I biquads. Coefficients are Q29 (range +-4) where they fit,
+ * boosting shelves need more range (b1 of a +12dB high shelf is about -8),
+ * so the format is chosen per band down to Q26 (range +-32) and the sum
+ * of products is scaled back by the band's shift. Samples are kept as Q14
+ * scaled int32 (16bit audio << 14, 12dB headroom). Each product takes the
+ * upper 32 bits of a 32x32 multiplication, which is a single MULSH
+ * instruction on the ESP32.
+ */
+#define DSP_COEF_BITS		29
+#define DSP_COEF_MIN_BITS	26
+#define DSP_SAMPLE_SHIFT	14
+#define DSP_SAMPLE_MAX(bits)	((1 << ((bits) - 1)) - 1)	// sum of products before the shift
+#define DSP_XFADE_FRAMES	64	// crossfade on coefficient change
+#define DSP_STAT_FRAMES		44100	// cycle count averaging period
+
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;
+    int bits;			// coefficient format, Q(bits)
+} dsp_coef_t;
+
+typedef struct {
+    int32_t x1, x2, y1, y2;
+} dsp_state_t;
+
+typedef struct {
+    dsp_filter_t type;
+    float freq, gain, q;
+} dsp_band_t;
+
+static dsp_band_t dsp_band[DSP_BANDS];
+static dsp_coef_t dsp_coef[DSP_BANDS];		// in use
+static dsp_coef_t dsp_coef_old[DSP_BANDS];	// faded out
+static dsp_coef_t dsp_coef_next[DSP_BANDS];	// to be used
+static dsp_state_t dsp_state[DSP_BANDS][2];
+static dsp_state_t dsp_state_old[DSP_BANDS][2];
+static int dsp_bands;				// bands in use (last active band + 1)
+static int dsp_bands_old;
+static int dsp_bands_next;
+static volatile bool dsp_update;
+static int dsp_xfade;
+static int dsp_rate = 44100;
+static _lock_t dsp_lock;
+
+static uint32_t dsp_cycles;
+static uint32_t dsp_frames;
+static uint32_t dsp_cycles_per_frame_avg;
+
+// calculate coefficients (RBJ audio EQ cookbook), -1 if out of range
+static int dsp_make_coef(const dsp_band_t *band, dsp_coef_t *coef)
+{
+    float w0 = 2 * (float)M_PI * band->freq / dsp_rate;
+    float cw = cosf(w0), sw = sinf(w0);
+    float alpha = sw / (2 * band->q);
+    float a = powf(10, band->gain / 40);
+    float b0, b1, b2, a0, a1, a2;
+
+    switch (band->type) {
+    case DSP_PEAK:
+	b0 = 1 + alpha * a;
+	b1 = -2 * cw;
+	b2 = 1 - alpha * a;
+	a0 = 1 + alpha / a;
+	a1 = -2 * cw;
+	a2 = 1 - alpha / a;
+	break;
+    case DSP_LOWSHELF: {
+	float sa = 2 * sqrtf(a) * alpha;
+	b0 = a * ((a + 1) - (a - 1) * cw + sa);
+	b1 = 2 * a * ((a - 1) - (a + 1) * cw);
+	b2 = a * ((a + 1) - (a - 1) * cw - sa);
+	a0 = (a + 1) + (a - 1) * cw + sa;
+	a1 = -2 * ((a - 1) + (a + 1) * cw);
+	a2 = (a + 1) + (a - 1) * cw - sa;
+	break;
+    }
+    case DSP_HIGHSHELF: {
+	float sa = 2 * sqrtf(a) * alpha;
+	b0 = a * ((a + 1) + (a - 1) * cw + sa);
+	b1 = -2 * a * ((a - 1) + (a + 1) * cw);
+	b2 = a * ((a + 1) + (a - 1) * cw - sa);
+	a0 = (a + 1) - (a - 1) * cw + sa;
+	a1 = 2 * ((a - 1) - (a + 1) * cw);
+	a2 = (a + 1) - (a - 1) * cw - sa;
+	break;
+    }
+    case DSP_HIGHPASS:
+	b0 = (1 + cw) / 2;
+	b1 = -(1 + cw);
+	b2 = (1 + cw) / 2;
+	a0 = 1 + alpha;
+	a1 = -2 * cw;
+	a2 = 1 - alpha;
+	break;
+    case DSP_LOWPASS:
+	b0 = (1 - cw) / 2;
+	b1 = 1 - cw;
+	b2 = (1 - cw) / 2;
+	a0 = 1 + alpha;
+	a1 = -2 * cw;
+	a2 = 1 - alpha;
+	break;
+    default:
+	b0 = a0 = 1;
+	b1 = b2 = a1 = a2 = 0;
+	break;
+    }
+
+    b0 /= a0;
+    b1 /= a0;
+    b2 /= a0;
+    a1 /= a0;
+    a2 /= a0;
+
+    // most precise format holding the largest coefficient
+    float max = fmaxf(fmaxf(fmaxf(fabsf(b0), fabsf(b1)), fmaxf(fabsf(b2), fabsf(a1))), fabsf(a2));
+    int bits = DSP_COEF_BITS;
+
+    while (max * (1 << bits) >= 2147483000.0f) {
+	if (--bits < DSP_COEF_MIN_BITS) {
+	    return -1;
+	}
+    }
+    coef->b0 = lrintf(b0 * (1 << bits));
+    coef->b1 = lrintf(b1 * (1 << bits));
+    coef->b2 = lrintf(b2 * (1 << bits));
+    coef->a1 = lrintf(a1 * (1 << bits));
+    coef->a2 = lrintf(a2 * (1 << bits));
+    coef->bits = bits;
+    return 0;
+}
+
+// calculate all coefficients for the audio task
+static void dsp_make_next(void)
+{
+    dsp_bands_next = 0;
+    for (int i = 0; i < DSP_BANDS; i++) {
+	if (dsp_make_coef(&dsp_band[i], &dsp_coef_next[i]) < 0) {
+	    // out of range at a new rate, leave the band out
+	    dsp_band[i].type = DSP_BYPASS;
+	    dsp_make_coef(&dsp_band[i], &dsp_coef_next[i]);
+	}
+	if (dsp_band[i].type != DSP_BYPASS) {
+	    dsp_bands_next = i + 1;
+	}
+    }
+    dsp_update = true;
+}
+
+// set sampling rate
+void dsp_set_rate(int rate)
+{
+    _lock_acquire(&dsp_lock);
+    dsp_rate = rate;
+    dsp_make_next();
+    _lock_release(&dsp_lock);
+}
+
+// configure a band
+int dsp_set_band(int band, dsp_filter_t type, float freq, float gain, float q)
+{
+    dsp_band_t b = { .type = type, .freq = freq, .gain = gain, .q = q };
+    dsp_coef_t coef;
+
+    if (band < 0 || band >= DSP_BANDS || freq <= 0 || freq >= dsp_rate / 2 || q <= 0) {
+	return -1;
+    }
+
+    _lock_acquire(&dsp_lock);
+    if (dsp_make_coef(&b, &coef) < 0) {
+	_lock_release(&dsp_lock);
+	return -1;
+    }
+    dsp_band[band] = b;
+    dsp_make_next();
+    _lock_release(&dsp_lock);
+
+    return 0;
+}
+
+// upper 32 bits of 32x32 multiplication
+static inline int32_t dsp_mulh(int32_t a, int32_t b)
+{
+    return ((int64_t)a * b) >> 32;
+}
+
+// one biquad section
+static inline int32_t dsp_biquad(const dsp_coef_t *c, dsp_state_t *s, int32_t x)
+{
+    int32_t y = dsp_mulh(c->b0, x) + dsp_mulh(c->b1, s->x1) + dsp_mulh(c->b2, s->x2)
+	- dsp_mulh(c->a1, s->y1) - dsp_mulh(c->a2, s->y2);
+
+    int32_t max = DSP_SAMPLE_MAX(c->bits);
+
+    // saturate before scaling back to samples
+    y = (y > max) ? max : (y < -max) ? -max : y;
+    y <<= 32 - c->bits;
+
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = y;
+    return y;
+}
+
+// biquad cascade of one channel
+static inline int32_t dsp_cascade(const dsp_coef_t *c, dsp_state_t (*s)[2], int bands, int ch, int32_t x)
+{
+    for (int i = 0; i < bands; i++) {
+	x = dsp_biquad(&c[i], &s[i][ch], x);
+    }
+    return x;
+}
+
+// scale back to 16bit with rounding and saturation
+static inline int16_t dsp_output(int32_t y)
+{
+    y = (y + (1 << (DSP_SAMPLE_SHIFT - 1))) >> DSP_SAMPLE_SHIFT;
+
+    return (y > INT16_MAX) ? INT16_MAX : (y < INT16_MIN) ? INT16_MIN : y;
+}
+
+// take new coefficients, crossfade from the old ones
+static void dsp_swap_coef(void)
+{
+    _lock_acquire(&dsp_lock);
+    memcpy(dsp_coef_old, dsp_coef, sizeof(dsp_coef));
+    memcpy(dsp_state_old, dsp_state, sizeof(dsp_state));
+    dsp_bands_old = dsp_bands;
+    memcpy(dsp_coef, dsp_coef_next, sizeof(dsp_coef));
+    dsp_bands = dsp_bands_next;
+    dsp_xfade = DSP_XFADE_FRAMES;
+    dsp_update = false;
+    _lock_release(&dsp_lock);
+}
+
+// process audio data by the biquad cascade
+void dsp_process(int16_t *audio, size_t frames)
+{
+    uint32_t start = dsp_ccount();
+    size_t n = 0;
+
+    if (dsp_update) {
+	dsp_swap_coef();
+    }
+
+    // crossfade from old to new coefficients
+    for (; n < frames && dsp_xfade > 0; n++, dsp_xfade--) {
+	int32_t g = dsp_xfade * 32768 / (DSP_XFADE_FRAMES + 1);
+
+	for (int ch = 0; ch < 2; ch++) {
+	    int32_t x = audio[n * 2 + ch] << DSP_SAMPLE_SHIFT;
+	    int32_t y_old = dsp_cascade(dsp_coef_old, dsp_state_old, dsp_bands_old, ch, x) >> 15;
+	    int32_t y_new = dsp_cascade(dsp_coef, dsp_state, dsp_bands, ch, x) >> 15;
+
+	    audio[n * 2 + ch] = dsp_output(y_old * g + y_new * (32768 - g));
+	}
+    }
+
+    if (dsp_bands == 0) {
+	return;
+    }
+    for (; n < frames; n++) {
+	for (int ch = 0; ch < 2; ch++) {
+	    int32_t x = audio[n * 2 + ch] << DSP_SAMPLE_SHIFT;
+
+	    audio[n * 2 + ch] = dsp_output(dsp_cascade(dsp_coef, dsp_state, dsp_bands, ch, x));
+	}
+    }
+
+    // average processing cost
+    dsp_cycles += dsp_ccount() - start;
+    dsp_frames += frames;
+    if (dsp_frames >= DSP_STAT_FRAMES) {
+	dsp_cycles_per_frame_avg = dsp_cycles / dsp_frames;
+	dsp_cycles = 0;
+	dsp_frames = 0;
+    }
+}
+
+// measured processing cost
+uint32_t dsp_cycles_per_frame(void)
+{
+    return dsp_cycles_per_frame_avg;
+}
+
+// number of bands not bypassed
+int dsp_active_bands(void)
+{
+    int n = 0;
+
+    for (int i = 0; i < dsp_bands; i++) {
+	if (dsp_band[i].type != DSP_BYPASS) {
+	    n++;
+	}
+    }
+    return n;
+}
@@ -0,0 +1,67 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __DSP_H__
+#define __DSP_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef CONFIG_SPDIF_DSP_BANDS
+#define DSP_BANDS	CONFIG_SPDIF_DSP_BANDS
+#else
+#define DSP_BANDS	4
+#endif
+
+typedef enum {
+    DSP_BYPASS = 0,
+    DSP_PEAK,		// peaking EQ, gain at freq
+    DSP_LOWSHELF,	// low shelf, gain below freq
+    DSP_HIGHSHELF,	// high shelf, gain above freq
+    DSP_HIGHPASS,	// 2nd order high-pass, gain ignored
+    DSP_LOWPASS,	// 2nd order low-pass, gain ignored
+} dsp_filter_t;
+
+/*
+ * set sampling rate, coefficients of all bands are recalculated
+ *   rate: sampling rate, 44100Hz, 48000Hz etc.
+ */
+void dsp_set_rate(int rate);
+
+/*
+ * configure a band of the biquad cascade
+ *   the new coefficients are crossfaded in by the audio task
+ *   band: 0 to DSP_BANDS - 1
+ *   type: filter type
+ *   freq: center or corner frequency in Hz
+ *   gain: gain in dB for peak and shelf filters
+ *   q: quality factor, 0.707 for Butterworth high-pass and low-pass
+ *   return: 0 on success, -1 on invalid parameter or when a coefficient
+ *           does not fit the fixed-point range (boosts above about 24dB)
+ */
+int dsp_set_band(int band, dsp_filter_t type, float freq, float gain, float q);
+
+/*
+ * process 16bit PCM stereo data by the biquad cascade
+ *   audio: audio data, modified in place
+ *   frames: number of stereo frames
+ */
+void dsp_process(int16_t *audio, size_t frames);
+
+/*
+ * measured processing cost
+ *   return: CPU cycles per stereo frame, averaged over about 1 second
+ *           (time stamp counter cycles on x86 hosts, 0 on other hosts)
+ */
+uint32_t dsp_cycles_per_frame(void);
+
+/*
+ * number of bands not bypassed
+ */
+int dsp_active_bands(void);
+
+#endif /* __DSP_H__ */
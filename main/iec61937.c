@@ -0,0 +1,88 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include "iec61937.h"
+
+#define ADTS_HEADER_SIZE	7
+#define BURST_HEADER_WORDS	4	// Pa, Pb, Pc, Pd
+
+static const int adts_rate_tab[16] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+    16000, 12000, 11025, 8000, 7350, 0, 0, 0,
+};
+
+// get sampling rate and burst repetition period of ADTS frame
+size_t iec61937_aac_info(const uint8_t *adts, size_t size, int *rate)
+{
+    if (size < ADTS_HEADER_SIZE) {
+	return 0;
+    }
+
+    // syncword 0xfff, layer 0
+    if (adts[0] != 0xff || (adts[1] & 0xf6) != 0xf0) {
+	return 0;
+    }
+
+    // frame_length must match
+    size_t length = ((adts[3] & 0x03) << 11) | (adts[4] << 3) | (adts[5] >> 5);
+    if (length != size) {
+	return 0;
+    }
+
+    // number_of_raw_data_blocks_in_frame + 1, 3 blocks have no data type
+    int blocks = (adts[6] & 0x03) + 1;
+    if (blocks == 3) {
+	return 0;
+    }
+
+    int r = adts_rate_tab[(adts[2] >> 2) & 0x0f];
+    if (r == 0) {
+	return 0;
+    }
+    *rate = r;
+
+    return IEC61937_AAC_FRAMES * blocks;
+}
+
+// wrap ADTS frame into IEC 61937 data burst
+size_t iec61937_frame_aac(int16_t *burst, size_t frames, const uint8_t *adts, size_t size)
+{
+    int rate;
+    size_t period = iec61937_aac_info(adts, size, &rate);
+    uint16_t *w = (uint16_t *)burst;
+    size_t i;
+
+    if (period == 0 || period > frames) {
+	return 0;
+    }
+    // payload must fit into the burst
+    if (BURST_HEADER_WORDS + (size + 1) / 2 > period * 2) {
+	return 0;
+    }
+
+    // burst preamble, Pd is the payload length in bits
+    w[0] = IEC61937_PA;
+    w[1] = IEC61937_PB;
+    w[2] = (period == IEC61937_AAC_FRAMES) ? IEC61937_MPEG2_AAC :
+	(period == IEC61937_AAC_FRAMES * 2) ? IEC61937_MPEG2_AAC_LSF_2048 : IEC61937_MPEG2_AAC_LSF_4096;
+    w[3] = size * 8;
+    w += BURST_HEADER_WORDS;
+
+    // payload, big endian in 16bit words
+    for (i = 0; i + 1 < size; i += 2) {
+	*w++ = (adts[i] << 8) | adts[i + 1];
+    }
+    if (i < size) {
+	*w++ = adts[i] << 8;
+    }
+
+    // stuffing up to the repetition period
+    memset(w, 0, (uint8_t *)(burst + period * 2) - (uint8_t *)w);
+
+    return period;
+}
@@ -0,0 +1,45 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __IEC61937_H__
+#define __IEC61937_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// burst preamble sync words
+#define IEC61937_PA		0xf872
+#define IEC61937_PB		0x4e1f
+
+// data types (IEC 61937-6)
+#define IEC61937_MPEG2_AAC		0x07	// 1 raw data block, 1024 frames
+#define IEC61937_MPEG2_AAC_LSF_2048	0x13	// 2 raw data blocks, 2048 frames
+#define IEC61937_MPEG2_AAC_LSF_4096	0x33	// 4 raw data blocks, 4096 frames
+
+#define IEC61937_AAC_FRAMES		1024	// burst repetition period per raw data block
+
+/*
+ * get sampling rate and burst repetition period of an ADTS frame
+ *   adts: MPEG-2/4 AAC ADTS frame with 1, 2 or 4 raw data blocks
+ *   size: number of bytes of the frame
+ *   rate: sampling rate of the frame is stored
+ *   return: burst repetition period in frames, 0 if not supported
+ */
+size_t iec61937_aac_info(const uint8_t *adts, size_t size, int *rate);
+
+/*
+ * wrap an ADTS frame into an IEC 61937 data burst
+ *   burst: 16bit stereo PCM buffer, filled with the burst and zero padding
+ *   frames: buffer size in stereo frames
+ *   adts: MPEG-2/4 AAC ADTS frame with 1, 2 or 4 raw data blocks
+ *   size: number of bytes of the frame
+ *   return: number of stereo frames in the burst (repetition period),
+ *           0 if the frame is not supported or does not fit
+ */
+size_t iec61937_frame_aac(int16_t *burst, size_t frames, const uint8_t *adts, size_t size);
+
+#endif /* __IEC61937_H__ */
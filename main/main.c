@@ -18,10 +18,12 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "esp_bt.h"
 #include "bt_app_core.h"
@@ -34,6 +36,15 @@
 #include "driver/i2s.h"
 
 #include "spdif.h"
+#ifdef CONFIG_SPDIF_DFS
+#include "dfs.h"
+#endif
+#ifdef CONFIG_SPDIF_SYNC
+#include "sync_net.h"
+#endif
+#ifdef CONFIG_SPDIF_TAP
+#include "pcm_tap_uart.h"
+#endif
 
 /* event for handler "bt_av_hdl_stack_up */
 enum {
@@ -43,9 +54,36 @@ enum {
 /* handler for bluetooth stack enabled events */
 static void bt_av_hdl_stack_evt(uint16_t event, void *p_param);
 
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+static SemaphoreHandle_t s_spdif_init_done;
+static int64_t s_spdif_init_us;
+
+/* S/PDIF does not depend on Bluetooth, initialize it in parallel on the other core */
+static void spdif_init_task(void *arg)
+{
+    int64_t start = esp_timer_get_time();
+
+#ifdef CONFIG_SPDIF_FIXED_RATE
+    spdif_init(CONFIG_SPDIF_FIXED_RATE_HZ); // initailize S/PDIF driver at fixed rate
+#else
+    spdif_init(44100); // initailize S/PDIF driver
+#endif
+    s_spdif_init_us = esp_timer_get_time() - start;
+
+    xSemaphoreGive(s_spdif_init_done);
+    vTaskDelete(NULL);
+}
+#endif
 
 void app_main()
 {
+    bt_app_boot_mark("app_main");
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+    s_spdif_init_done = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(spdif_init_task, "SpdifInitT", 2048, NULL, configMAX_PRIORITIES - 3, NULL, 1);
+#endif
+
     /* Initialize NVS — it is used to store PHY calibration data */
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -53,6 +91,7 @@ void app_main()
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
+    bt_app_boot_mark("NVS init");
 
 #ifndef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
     i2s_config_t i2s_config = {
@@ -87,11 +126,8 @@ void app_main()
     i2s_set_pin(0, &pin_config);
 #endif
 
-#else
-
-    spdif_init(44100); // initailize S/PDIF driver
-
-#endif // SPDIF
+    bt_app_boot_mark("I2S init");
+#endif
 
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_BLE));
 
@@ -105,6 +141,7 @@ void app_main()
         ESP_LOGE(BT_AV_TAG, "%s enable controller failed: %s\n", __func__, esp_err_to_name(err));
         return;
     }
+    bt_app_boot_mark("BT controller");
 
     if ((err = esp_bluedroid_init()) != ESP_OK) {
         ESP_LOGE(BT_AV_TAG, "%s initialize bluedroid failed: %s\n", __func__, esp_err_to_name(err));
@@ -115,6 +152,28 @@ void app_main()
         ESP_LOGE(BT_AV_TAG, "%s enable bluedroid failed: %s\n", __func__, esp_err_to_name(err));
         return;
     }
+    bt_app_boot_mark("Bluedroid");
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_SPDIF
+    /* join S/PDIF initialization before any audio can arrive */
+    xSemaphoreTake(s_spdif_init_done, portMAX_DELAY);
+    vSemaphoreDelete(s_spdif_init_done);
+    ESP_LOGI(BT_AV_TAG, "S/PDIF init took %d ms in parallel", (int)(s_spdif_init_us / 1000));
+    bt_app_boot_mark("S/PDIF init joined");
+#endif
+#ifdef CONFIG_SPDIF_DFS
+    /* scale CPU frequency by the measured audio load */
+    dfs_init();
+#endif
+#ifdef CONFIG_SPDIF_TAP
+    /* send the played PCM data on the tap UART */
+    pcm_tap_uart_init();
+#endif
+#ifdef CONFIG_SPDIF_SYNC
+    /* join the WiFi network, lead or follow the other sinks */
+    sync_net_init();
+    bt_app_boot_mark("sync init");
+#endif
 
     /* create application task */
     bt_app_task_start_up();
@@ -206,6 +265,15 @@ static void bt_av_hdl_stack_evt(uint16_t event, void *p_param)
 
         /* set discoverable and connectable mode, wait to be connected */
         esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+        bt_app_boot_mark("stack up");
+#ifdef CONFIG_EXAMPLE_MEM_REPORT
+        bt_app_mem_report();
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_AUTO_RECONNECT
+        /* page the last source instead of waiting for the user to reconnect */
+        bt_app_av_reconnect();
+#endif
         break;
     }
     default:
@@ -0,0 +1,136 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+#include "pcm_tap.h"
+
+/*
+ * Side ring of the PCM tap, one producer (the encoder) and one consumer.
+ * The producer only advances head, the consumer only tail, so neither
+ * takes a lock. A record is formatted and checked by the consumer, the
+ * encoder copies one buffer of PCM data and nothing else.
+ */
+
+#ifdef CONFIG_SPDIF_TAP_BUFS
+#define PCM_TAP_BUFS		CONFIG_SPDIF_TAP_BUFS
+#else
+#define PCM_TAP_BUFS		16	// records, about 35ms at 44.1kHz
+#endif
+
+typedef struct {
+    uint32_t seq;
+    int32_t rate;
+    uint16_t flags;
+    int16_t pcm[PCM_TAP_FRAMES * 2];
+} pcm_tap_rec_t;
+
+static pcm_tap_rec_t tap_ring[PCM_TAP_BUFS];
+static volatile uint32_t tap_head;	// records put
+static volatile uint32_t tap_tail;	// records taken
+static uint32_t tap_seq;		// records offered
+static volatile uint32_t tap_dropped;
+
+// CRC-32, reflected 0xedb88320, 4 bits at a time
+static const uint32_t crc_tab[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+// CRC-32 (as zlib)
+uint32_t pcm_tap_crc32(uint32_t crc, const uint8_t *p, size_t size)
+{
+    crc = ~crc;
+    while (size-- > 0) {
+	crc ^= *p++;
+	crc = (crc >> 4) ^ crc_tab[crc & 0x0f];
+	crc = (crc >> 4) ^ crc_tab[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+// initialize
+void pcm_tap_init(void)
+{
+    tap_head = tap_tail = 0;
+    tap_seq = 0;
+    tap_dropped = 0;
+}
+
+// put a record, drop it when the ring is full
+bool SPDIF_IRAM_ATTR pcm_tap_put(const int16_t *pcm, int rate, uint16_t flags)
+{
+    uint32_t seq = tap_seq++;
+    pcm_tap_rec_t *rec;
+
+    if (tap_head - tap_tail >= PCM_TAP_BUFS) {
+	tap_dropped++;
+	return false;
+    }
+    rec = &tap_ring[tap_head % PCM_TAP_BUFS];
+    rec->seq = seq;
+    rec->rate = rate;
+    rec->flags = flags;
+    if (pcm) {
+	memcpy(rec->pcm, pcm, sizeof(rec->pcm));
+    } else {
+	memset(rec->pcm, 0, sizeof(rec->pcm));
+    }
+    __sync_synchronize();
+    tap_head++;
+    return true;
+}
+
+// take a record as a frame
+size_t pcm_tap_get(uint8_t *frame)
+{
+    const pcm_tap_rec_t *rec;
+    uint8_t *p = frame + PCM_TAP_HEADER_SIZE;
+
+    if (tap_tail == tap_head) {
+	return 0;
+    }
+    __sync_synchronize();
+    rec = &tap_ring[tap_tail % PCM_TAP_BUFS];
+    put32(frame, PCM_TAP_MAGIC);
+    put32(frame + 4, rec->seq);
+    put32(frame + 8, rec->rate);
+    put16(frame + 12, PCM_TAP_FRAMES);
+    put16(frame + 14, rec->flags);
+    for (int i = 0; i < PCM_TAP_FRAMES * 2; i++, p += 2) {
+	put16(p, rec->pcm[i]);
+    }
+    __sync_synchronize();
+    tap_tail++;
+
+    // the dropped count includes records dropped before this one was taken
+    put32(frame + 16, tap_dropped);
+    put32(p, pcm_tap_crc32(0, frame, p - frame));
+    return PCM_TAP_FRAME_SIZE;
+}
+
+// number of dropped records
+uint32_t pcm_tap_get_dropped(void)
+{
+    return tap_dropped;
+}
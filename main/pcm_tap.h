@@ -0,0 +1,74 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __PCM_TAP_H__
+#define __PCM_TAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "spdif_enc.h"
+
+/*
+ * Copy of the PCM data encoded by spdif_enc.c, after the gain, one
+ * record per S/PDIF buffer. The encoder puts records into a side ring
+ * and never waits, a record is dropped and counted when the ring is
+ * full. A consumer (pcm_tap_uart.c, tools/spdif_tool.c) takes them as
+ * framed records for tools/pcm_tap_rx.c.
+ *
+ * frame, little endian
+ *    0 magic "PCMT"
+ *    4 sequence number, S/PDIF buffers since pcm_tap_init(), a gap
+ *      is dropped data
+ *    8 sampling rate
+ *   12 frames (PCM_TAP_FRAMES), flags
+ *   16 dropped records since pcm_tap_init()
+ *   20 PCM data, 16bit stereo
+ *  404 CRC-32 of the bytes before (as zlib)
+ */
+
+#define PCM_TAP_MAGIC		0x544d4350	// "PCMT"
+#define PCM_TAP_FRAMES		(SPDIF_BLOCK_SAMPLES / SPDIF_BUF_DIV)
+#define PCM_TAP_HEADER_SIZE	20
+#define PCM_TAP_FRAME_SIZE	(PCM_TAP_HEADER_SIZE + PCM_TAP_FRAMES * 4 + 4)
+
+#define PCM_TAP_NONAUDIO	0x0001		// flag: IEC 61937 data, not PCM
+
+/*
+ * initialize, empty the ring and restart the sequence number
+ */
+void pcm_tap_init(void);
+
+/*
+ * put a record, called by the encoder for every buffer
+ *   pcm: PCM_TAP_FRAMES stereo frames, NULL for silence
+ *   rate: sampling rate
+ *   flags: PCM_TAP_NONAUDIO or 0
+ *   return: false when the record was dropped
+ */
+bool pcm_tap_put(const int16_t *pcm, int rate, uint16_t flags);
+
+/*
+ * take a record as a frame
+ *   frame: PCM_TAP_FRAME_SIZE bytes
+ *   return: frame size, 0 when the ring is empty
+ *   called by one consumer task, never blocks the encoder
+ */
+size_t pcm_tap_get(uint8_t *frame);
+
+/*
+ * number of records dropped since pcm_tap_init()
+ */
+uint32_t pcm_tap_get_dropped(void);
+
+/*
+ * CRC-32 (as zlib), used for the frame check
+ *   crc: 0 or the result of the previous part
+ */
+uint32_t pcm_tap_crc32(uint32_t crc, const uint8_t *p, size_t size);
+
+#endif /* __PCM_TAP_H__ */
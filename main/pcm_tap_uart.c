@@ -0,0 +1,79 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "pcm_tap_uart.h"
+
+#ifdef CONFIG_SPDIF_TAP_UART_NUM
+#define TAP_UART		CONFIG_SPDIF_TAP_UART_NUM
+#define TAP_TX_PIN		CONFIG_SPDIF_TAP_TX_PIN
+#define TAP_BAUD		CONFIG_SPDIF_TAP_BAUD
+#else
+#define TAP_UART		1
+#define TAP_TX_PIN		4
+#define TAP_BAUD		3000000
+#endif
+
+#define TAP_TAG			"PCM_TAP"
+#define TAP_TX_BUF_SIZE		(PCM_TAP_FRAME_SIZE * 4)
+#define TAP_RX_BUF_SIZE		256	// not used, the driver needs more than the FIFO
+#define TAP_POLL_MS		5	// ring check while empty, 2 records at 48kHz
+#define TAP_REPORT_MS		5000	// drop log period
+#define TAP_TASK_STACK		2048
+
+static uint8_t tap_frame[PCM_TAP_FRAME_SIZE];
+
+// send the tap records, log drops
+static void pcm_tap_task_handler(void *arg)
+{
+    uint32_t dropped = 0;
+    TickType_t last_report = xTaskGetTickCount();
+
+    for (;;) {
+	size_t size = pcm_tap_get(tap_frame);
+
+	if (size > 0) {
+	    uart_write_bytes(TAP_UART, (const char *)tap_frame, size);
+	} else {
+	    vTaskDelay(pdMS_TO_TICKS(TAP_POLL_MS));
+	}
+	if (xTaskGetTickCount() - last_report >= pdMS_TO_TICKS(TAP_REPORT_MS)) {
+	    uint32_t n = pcm_tap_get_dropped();
+
+	    if (n != dropped) {
+		ESP_LOGW(TAP_TAG, "%u records dropped, the UART is too slow", n - dropped);
+		dropped = n;
+	    }
+	    last_report = xTaskGetTickCount();
+	}
+    }
+}
+
+// start sending the PCM tap
+void pcm_tap_uart_init(void)
+{
+    uart_config_t uart_config = {
+	.baud_rate = TAP_BAUD,
+	.data_bits = UART_DATA_8_BITS,
+	.parity = UART_PARITY_DISABLE,
+	.stop_bits = UART_STOP_BITS_1,
+	.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+    };
+
+    ESP_ERROR_CHECK(uart_param_config(TAP_UART, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(TAP_UART, TAP_TX_PIN, UART_PIN_NO_CHANGE,
+				 UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    ESP_ERROR_CHECK(uart_driver_install(TAP_UART, TAP_RX_BUF_SIZE, TAP_TX_BUF_SIZE, 0, NULL, 0));
+
+    pcm_tap_init();
+    xTaskCreate(pcm_tap_task_handler, "PcmTapT", TAP_TASK_STACK, NULL, 5, NULL);
+    ESP_LOGI(TAP_TAG, "UART%d TX GPIO%d, %d baud", TAP_UART, TAP_TX_PIN, TAP_BAUD);
+}
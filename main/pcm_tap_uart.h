@@ -0,0 +1,20 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __PCM_TAP_UART_H__
+#define __PCM_TAP_UART_H__
+
+#include "pcm_tap.h"
+
+/*
+ * start sending the PCM tap
+ *   the frames of pcm_tap_get() are sent on the TX pin of the tap UART,
+ *   tools/pcm_tap_rx.c writes them to a WAV file, drops are logged
+ */
+void pcm_tap_uart_init(void);
+
+#endif /* __PCM_TAP_UART_H__ */
@@ -0,0 +1,250 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <math.h>
+#include "plc.h"
+
+/*
+ * Waveform repetition packet loss concealment.
+ * At the start of a gap the pitch period is searched once in the history
+ * (bounded cost), then the last period is repeated for PLC_HOLD_FRAMES and
+ * faded out over PLC_FADE_FRAMES. Per frame cost is constant. A signal
+ * that does not repeat with the period over the whole history (chords,
+ * noise) would be predicted worse than by silence: it is repeated at the
+ * correlation as gain, which minimizes the expected error, and faded out
+ * over PLC_XFADE_FRAMES. At the end of the stream nothing was lost, the
+ * signal is only faded out over PLC_XFADE_FRAMES to avoid a click.
+ */
+#define PLC_HIST_FRAMES		640	// history length
+#define PLC_MIN_LAG		32	// shortest pitch period, about 1.4kHz
+#define PLC_MAX_LAG		400	// longest pitch period, about 110Hz
+#define PLC_WINDOW		128	// correlation window
+#define PLC_DECIMATE		2	// pitch search resolution
+#define PLC_HOLD_FRAMES		480	// repeat at full level, about 10ms
+#define PLC_FADE_FRAMES		960	// then fade out, about 20ms
+#define PLC_XFADE_FRAMES	96	// crossfade into received data, about 2ms
+#define PLC_MIN_PERIODICITY	0.95f	// squared correlation for the hold
+
+static int16_t plc_hist[PLC_HIST_FRAMES][2];
+static int plc_hist_pos;		// next write position
+static int plc_hist_len;		// valid frames in history
+static bool plc_active;			// concealing a gap
+static int plc_base;			// history position at the start of the gap
+static int plc_lag;			// repeated period
+static int plc_offset;			// position within the period
+static int plc_count;			// concealed frames
+static int plc_fade_start;		// concealed frames before the fade out
+static int plc_fade_len;		// fade out length
+static int32_t plc_fade_gain;		// gain at the start of the fade out, Q15
+static bool plc_ending;			// stream ended, fade out at once
+static int plc_xfade;			// remaining crossfade frames
+
+// forget audio history
+void plc_reset(void)
+{
+    plc_hist_pos = 0;
+    plc_hist_len = 0;
+    plc_active = false;
+    plc_ending = false;
+    plc_xfade = 0;
+}
+
+// history frame, back frames before the one at pos
+static inline const int16_t *plc_hist_frame(int pos, int back)
+{
+    int i = pos - 1 - back;
+
+    return plc_hist[(i < 0) ? i + PLC_HIST_FRAMES : i];
+}
+
+// mono history sample for pitch search
+static inline int32_t plc_mono(int back)
+{
+    const int16_t *f = plc_hist_frame(plc_hist_pos, back);
+
+    return (f[0] + f[1]) >> 1;
+}
+
+// find pitch period by normalized autocorrelation of the latest window
+static int plc_find_lag(void)
+{
+    int best = PLC_MAX_LAG;
+    float best_score = 0;
+
+    for (int lag = PLC_MIN_LAG; lag <= PLC_MAX_LAG; lag += PLC_DECIMATE) {
+	int64_t corr = 0, energy = 1;
+
+	for (int n = 0; n < PLC_WINDOW; n += PLC_DECIMATE) {
+	    int32_t x = plc_mono(n);
+	    int32_t y = plc_mono(n + lag);
+
+	    corr += x * y;
+	    energy += y * y;
+	}
+	if (corr > 0) {
+	    float score = (float)corr * corr / energy;
+
+	    if (score > best_score) {
+		best_score = score;
+		best = lag;
+	    }
+	}
+    }
+    return best;
+}
+
+// squared correlation of the history with itself lag frames before
+static float plc_periodicity(int lag)
+{
+    int64_t corr = 0, ex = 1, ey = 1;
+
+    for (int n = 0; n + lag < PLC_HIST_FRAMES; n++) {
+	int32_t x = plc_mono(n);
+	int32_t y = plc_mono(n + lag);
+
+	corr += (int64_t)x * y;
+	ex += (int64_t)x * x;
+	ey += (int64_t)y * y;
+    }
+    return (corr > 0) ? (float)corr / ex * corr / ey : 0;
+}
+
+// concealment gain in Q15
+static inline int32_t plc_gain(void)
+{
+    int n = plc_count - plc_fade_start;
+
+    if (n < 0) {
+	return plc_fade_gain;
+    } else if (n < plc_fade_len) {
+	return plc_fade_gain * (plc_fade_len - n) / plc_fade_len;
+    }
+    return 0;
+}
+
+// fade out from gain after hold frames
+static void plc_set_fade(int32_t gain, int hold, int len)
+{
+    plc_fade_gain = gain;
+    plc_fade_start = plc_count + hold;
+    plc_fade_len = len;
+}
+
+// next concealment frame, the last period before the gap is repeated
+static inline void plc_next(int32_t *l, int32_t *r)
+{
+    const int16_t *f = plc_hist_frame(plc_base, plc_lag - 1 - plc_offset);
+    int32_t g = plc_gain();
+
+    *l = (f[0] * g) >> 15;
+    *r = (f[1] * g) >> 15;
+    if (++plc_offset >= plc_lag) {
+	plc_offset = 0;
+    }
+    plc_count++;
+}
+
+// pass received audio data
+void plc_update(int16_t *audio, size_t frames)
+{
+    size_t n;
+
+    if (plc_active) {
+	// nothing to crossfade from when faded out, as after silence
+	plc_active = false;
+	plc_xfade = (plc_gain() > 0) ? PLC_XFADE_FRAMES : 0;
+    }
+    plc_ending = false;
+
+    // crossfade from concealment signal (or silence) into received data,
+    // the period before the gap is not overwritten by then
+    for (n = 0; n < frames && plc_xfade > 0; n++, plc_xfade--) {
+	int32_t g = plc_xfade * 32768 / (PLC_XFADE_FRAMES + 1);
+	int32_t l, r;
+
+	plc_next(&l, &r);
+	audio[n * 2] = (audio[n * 2] * (32768 - g) + l * g) >> 15;
+	audio[n * 2 + 1] = (audio[n * 2 + 1] * (32768 - g) + r * g) >> 15;
+    }
+
+    // update history
+    if (frames > PLC_HIST_FRAMES) {
+	audio += (frames - PLC_HIST_FRAMES) * 2;
+	frames = PLC_HIST_FRAMES;
+    }
+    while (frames > 0) {
+	size_t len = PLC_HIST_FRAMES - plc_hist_pos;
+
+	if (len > frames) {
+	    len = frames;
+	}
+	memcpy(plc_hist[plc_hist_pos], audio, len * sizeof(plc_hist[0]));
+	plc_hist_pos = (plc_hist_pos + len) % PLC_HIST_FRAMES;
+	audio += len * 2;
+	frames -= len;
+	plc_hist_len = (plc_hist_len + len > PLC_HIST_FRAMES) ? PLC_HIST_FRAMES : plc_hist_len + len;
+    }
+}
+
+// generate concealment data
+bool plc_conceal(int16_t *out, size_t frames)
+{
+    if (plc_hist_len < PLC_HIST_FRAMES) {
+	return false;
+    }
+
+    if (!plc_active) {
+	if (plc_xfade > 0) {
+	    // gap again while crossfading, keep going on with the period
+	    plc_xfade = 0;
+	    if (plc_ending) {
+		plc_set_fade(plc_gain(), 0, PLC_XFADE_FRAMES);
+	    }
+	} else {
+	    float p;
+
+	    plc_base = plc_hist_pos;
+	    plc_lag = plc_find_lag();
+	    plc_offset = 0;
+	    plc_count = 0;
+	    if (plc_ending) {
+		plc_set_fade(32768, 0, PLC_XFADE_FRAMES);
+	    } else if ((p = plc_periodicity(plc_lag)) < PLC_MIN_PERIODICITY) {
+		plc_set_fade(32768 * sqrtf(p), 0, PLC_XFADE_FRAMES);
+	    } else {
+		plc_set_fade(32768, PLC_HOLD_FRAMES, PLC_FADE_FRAMES);
+	    }
+	}
+	plc_active = true;
+    }
+    if (plc_gain() == 0) {
+	return false;
+    }
+
+    for (size_t n = 0; n < frames; n++) {
+	int32_t l, r;
+
+	plc_next(&l, &r);
+	out[n * 2] = l;
+	out[n * 2 + 1] = r;
+    }
+    return true;
+}
+
+// stream ended
+void plc_end(void)
+{
+    if (plc_ending) {
+	return;
+    }
+    plc_ending = true;
+    if (plc_active && plc_count < plc_fade_start + plc_fade_len) {
+	// already concealing, shorten the rest
+	plc_set_fade(plc_gain(), 0, PLC_XFADE_FRAMES);
+    }
+}
@@ -0,0 +1,45 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __PLC_H__
+#define __PLC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * forget audio history, e.g. on stream start
+ */
+void plc_reset(void);
+
+/*
+ * pass received 16bit PCM stereo data
+ *   the history for concealment is updated, after a gap the start of
+ *   the data is crossfaded from the concealment signal
+ *   audio: audio data, modified in place
+ *   frames: number of stereo frames
+ */
+void plc_update(int16_t *audio, size_t frames);
+
+/*
+ * generate concealment data for missing audio data
+ *   the last pitch period is repeated, then faded out
+ *   out: output buffer for 16bit PCM stereo data
+ *   frames: number of stereo frames
+ *   return: false if there is nothing to conceal (faded out or no history)
+ */
+bool plc_conceal(int16_t *out, size_t frames);
+
+/*
+ * the stream ended (suspended or stopped by the source)
+ *   the missing data is not lost, plc_conceal() only fades out the last
+ *   period within about 2ms, until audio data is passed again
+ */
+void plc_end(void);
+
+#endif /* __PLC_H__ */
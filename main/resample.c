@@ -0,0 +1,169 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <math.h>
+#include "resample.h"
+
+#ifdef ESP_PLATFORM
+#include "sys/lock.h"
+#else
+typedef int _lock_t;
+#define _lock_acquire(l)	((void)(l))
+#define _lock_release(l)	((void)(l))
+#endif
+
+/*
+ * Polyphase FIR converter with linear interpolation between phases.
+ * The input position advances by in_rate / out_rate exactly (integer
+ * arithmetic), only the phase within the filter is approximated.
+ */
+#define RESAMPLE_CHANNELS	2
+#define RESAMPLE_TAPS		48	// filter length in input samples
+#define RESAMPLE_PHASE_BITS	6
+#define RESAMPLE_PHASES		(1 << RESAMPLE_PHASE_BITS)	// filter phases per input sample
+#define RESAMPLE_COEF_BITS	15	// Q15 coefficients
+#define RESAMPLE_ROLLOFF	0.93f	// cutoff relative to the lower Nyquist frequency
+#define RESAMPLE_KAISER_BETA	8.0f	// Kaiser window, about 80dB stopband
+
+static int16_t resample_coef[RESAMPLE_PHASES + 1][RESAMPLE_TAPS];
+static int16_t resample_hist[RESAMPLE_CHANNELS][RESAMPLE_TAPS * 2];	// doubled for contiguous window
+static int resample_hist_pos;
+static int resample_in_rate;
+static int resample_out_rate;
+static uint32_t resample_pos;		// output position in 1/out_rate input samples
+static uint32_t resample_pos_scale;	// 2^32 / out_rate
+static _lock_t resample_lock;
+
+// zeroth order modified Bessel function of the first kind
+static float bessel_i0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+
+    for (int k = 1; k < 32; k++) {
+	term *= (x / (2 * k)) * (x / (2 * k));
+	sum += term;
+	if (term < sum * 1e-7f) {
+	    break;
+	}
+    }
+    return sum;
+}
+
+// windowed sinc low-pass filter, cutoff fc relative to the input rate
+static void resample_make_coef(float fc)
+{
+    const float half = RESAMPLE_TAPS / 2;
+    float i0_beta = bessel_i0(RESAMPLE_KAISER_BETA);
+
+    for (int p = 0; p <= RESAMPLE_PHASES; p++) {
+	float c[RESAMPLE_TAPS];
+	float sum = 0;
+
+	for (int k = 0; k < RESAMPLE_TAPS; k++) {
+	    // distance between output point and input sample k
+	    float t = half - 1 + (float)p / RESAMPLE_PHASES - k;
+	    float w = 1.0f - (t / half) * (t / half);
+	    float s = (t == 0) ? 1.0f : sinf((float)M_PI * 2 * fc * t) / ((float)M_PI * 2 * fc * t);
+
+	    c[k] = s * bessel_i0(RESAMPLE_KAISER_BETA * sqrtf(w > 0 ? w : 0)) / i0_beta;
+	    sum += c[k];
+	}
+	// unity gain at DC for every phase
+	for (int k = 0; k < RESAMPLE_TAPS; k++) {
+	    resample_coef[p][k] = lrintf(c[k] / sum * (1 << RESAMPLE_COEF_BITS));
+	}
+    }
+}
+
+// set conversion rates
+void resample_set_rates(int in_rate, int out_rate)
+{
+    _lock_acquire(&resample_lock);
+    if (in_rate != resample_in_rate || out_rate != resample_out_rate) {
+	float nyquist = (in_rate < out_rate) ? in_rate : out_rate;
+
+	resample_make_coef(RESAMPLE_ROLLOFF * nyquist / 2 / in_rate);
+	resample_in_rate = in_rate;
+	resample_out_rate = out_rate;
+	resample_pos_scale = (uint32_t)((1ULL << 32) / out_rate);
+    }
+    memset(resample_hist, 0, sizeof(resample_hist));
+    resample_hist_pos = 0;
+    resample_pos = 0;
+    _lock_release(&resample_lock);
+}
+
+// filter output of one phase
+static inline int32_t resample_dot(const int16_t *x, const int16_t *c)
+{
+    int32_t acc = 0;
+
+    for (int k = 0; k < RESAMPLE_TAPS; k++) {
+	acc += x[k] * c[k];
+    }
+    return acc;
+}
+
+// convert 16bit PCM stereo data
+size_t resample_process(const int16_t *in, size_t *in_frames, int16_t *out, size_t out_frames)
+{
+    size_t i = 0, o = 0;
+
+    _lock_acquire(&resample_lock);
+
+    if (resample_in_rate == resample_out_rate) {
+	// nothing to convert
+	o = (*in_frames < out_frames) ? *in_frames : out_frames;
+	memcpy(out, in, o * RESAMPLE_CHANNELS * sizeof(int16_t));
+	*in_frames = o;
+	_lock_release(&resample_lock);
+	return o;
+    }
+
+    for (;;) {
+	// output samples located before the next input sample
+	while (resample_pos < resample_out_rate) {
+	    if (o >= out_frames) {
+		goto done;
+	    }
+
+	    uint32_t phase = resample_pos * resample_pos_scale;	// Q32 fraction
+	    const int16_t *c0 = resample_coef[phase >> (32 - RESAMPLE_PHASE_BITS)];
+	    const int16_t *c1 = c0 + RESAMPLE_TAPS;
+	    int32_t frac = (phase >> (32 - RESAMPLE_PHASE_BITS - 15)) & 0x7fff;	// Q15 between phases
+
+	    for (int ch = 0; ch < RESAMPLE_CHANNELS; ch++) {
+		const int16_t *x = &resample_hist[ch][resample_hist_pos];
+		int32_t y0 = resample_dot(x, c0);
+		int32_t y1 = resample_dot(x, c1);
+		int32_t y = (y0 + ((((int64_t)y1 - y0) * frac) >> 15) + (1 << (RESAMPLE_COEF_BITS - 1))) >> RESAMPLE_COEF_BITS;
+
+		out[o * RESAMPLE_CHANNELS + ch] = (y > INT16_MAX) ? INT16_MAX : (y < INT16_MIN) ? INT16_MIN : y;
+	    }
+	    o++;
+	    resample_pos += resample_in_rate;
+	}
+
+	// advance to the next input sample
+	if (i >= *in_frames) {
+	    break;
+	}
+	for (int ch = 0; ch < RESAMPLE_CHANNELS; ch++) {
+	    resample_hist[ch][resample_hist_pos] = resample_hist[ch][resample_hist_pos + RESAMPLE_TAPS] =
+		in[i * RESAMPLE_CHANNELS + ch];
+	}
+	resample_hist_pos = (resample_hist_pos + 1) % RESAMPLE_TAPS;
+	resample_pos -= resample_out_rate;
+	i++;
+    }
+
+done:
+    _lock_release(&resample_lock);
+    *in_frames = i;
+    return o;
+}
@@ -0,0 +1,31 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * set conversion rates, resets the converter state
+ *   in_rate: input sampling rate, 44100Hz, 48000Hz etc.
+ *   out_rate: output sampling rate
+ */
+void resample_set_rates(int in_rate, int out_rate);
+
+/*
+ * convert 16bit PCM stereo data
+ *   in: input data
+ *   in_frames: number of input frames, updated to the number of consumed frames
+ *   out: output buffer
+ *   out_frames: size of output buffer in frames
+ *   return: number of output frames
+ */
+size_t resample_process(const int16_t *in, size_t *in_frames, int16_t *out, size_t out_frames);
+
+#endif /* __RESAMPLE_H__ */
@@ -5,8 +5,20 @@
     software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
     CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "driver/i2s.h"
+#include "soc/rtc.h"
+#include "soc/i2s_struct.h"
+#include "esp_efuse.h"
+#include "esp32/clk.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sys/lock.h"
+#include "spdif.h"
+#include "spdif_enc.h"
+#include "spdif_apll.h"
 
 #ifdef CONFIG_SPDIF_DATA_PIN
 #define SPDIF_DATA_PIN CONFIG_SPDIF_DATA_PIN
@@ -14,87 +26,153 @@
 #define SPDIF_DATA_PIN		27
 #endif
 
+#define SPDIF_TAG		"SPDIF"
 #define I2S_NUM			(0)
 
 #define I2S_BITS_PER_SAMPLE	(32)
 #define I2S_CHANNELS		2
 #define BMC_BITS_PER_SAMPLE	64
 #define BMC_BITS_FACTOR		(BMC_BITS_PER_SAMPLE / I2S_BITS_PER_SAMPLE)
-#define SPDIF_BLOCK_SAMPLES	192
-#define SPDIF_BUF_DIV		2	// double buffering
+#ifdef CONFIG_SPDIF_DMA_BUF_COUNT
+#define DMA_BUF_COUNT		CONFIG_SPDIF_DMA_BUF_COUNT
+#else
 #define DMA_BUF_COUNT		2
-#define DMA_BUF_LEN		(SPDIF_BLOCK_SAMPLES * BMC_BITS_PER_SAMPLE / I2S_BITS_PER_SAMPLE / SPDIF_BUF_DIV)
-#define I2S_BUG_MAGIC		(26 * 1000 * 1000)	// magic number for avoiding I2S bug
-#define SPDIF_BLOCK_SIZE	(SPDIF_BLOCK_SAMPLES * (BMC_BITS_PER_SAMPLE/8) * I2S_CHANNELS)
-#define SPDIF_BUF_SIZE		(SPDIF_BLOCK_SIZE / SPDIF_BUF_DIV)
-#define SPDIF_BUF_ARRAY_SIZE	(SPDIF_BUF_SIZE / sizeof(uint32_t))
+#endif
+#define DMA_BUF_LEN		(SPDIF_BUF_SIZE / (I2S_BITS_PER_SAMPLE / 8) / I2S_CHANNELS)
+#define SPDIF_BUF_FRAMES	(SPDIF_BLOCK_SAMPLES / SPDIF_BUF_DIV)
+#define SPDIF_STAT_BUFS		500	// cycle count averaging period, about 1s
+#define SPDIF_WRITER_IDLE_US	(20 * 1000)	// no write since: no task runs the gain ramp
+
+static _lock_t spdif_lock;
+
+/*
+ * Underrun detection. Each S/PDIF buffer fills one DMA buffer, and when
+ * i2s_write() returns all DMA buffers are queued (see play time below).
+ * A write starting later than they last was preceded by cleared buffers
+ * (tx_desc_auto_clear), one per buffer time. This is counted from
+ * esp_timer, which keeps running through flash operations, not from
+ * the driver's TX_DONE events: its interrupt is not in IRAM, so events
+ * are delayed and merged exactly during such a stall. A writing task
+ * stopped on purpose mutes the output first (bt_i2s_task_shut_down()),
+ * so a write after SPDIF_WRITER_IDLE_US with the output muted starts
+ * counting anew instead of counting the time without a task.
+ */
+static uint32_t spdif_dma_written;
+static volatile uint32_t spdif_underruns;
 
-static uint32_t spdif_buf[SPDIF_BUF_ARRAY_SIZE];
-static uint32_t *spdif_ptr;
+/*
+ * Cost of the output. The writing task produces the buffers (DSP, PLC,
+ * resampling, encoding) and waits in i2s_write() for the rest. The run
+ * time FreeRTOS counts for the task leaves out the waiting and the time
+ * other tasks and cores take, it is read every SPDIF_STAT_BUFS buffers.
+ * Without FREERTOS_GENERATE_RUN_TIME_STATS nothing is measured.
+ */
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static TaskHandle_t spdif_stat_task;
+static uint32_t spdif_stat_run_time;	// run time counter, esp_timer us
+static uint32_t spdif_bufs;
+#endif
+static volatile uint32_t spdif_cycles_per_frame_avg;
 
 /*
- * 8bit PCM to 16bit BMC conversion table, LSb first, 1 end
+ * Play time. i2s_write() returns when a DMA buffer got free, so all
+ * DMA buffers are queued then and the next buffer starts after them.
  */
-static const int16_t bmc_tab[256] = {
-    0x3333, 0xb333, 0xd333, 0x5333, 0xcb33, 0x4b33, 0x2b33, 0xab33,
-    0xcd33, 0x4d33, 0x2d33, 0xad33, 0x3533, 0xb533, 0xd533, 0x5533,
-    0xccb3, 0x4cb3, 0x2cb3, 0xacb3, 0x34b3, 0xb4b3, 0xd4b3, 0x54b3,
-    0x32b3, 0xb2b3, 0xd2b3, 0x52b3, 0xcab3, 0x4ab3, 0x2ab3, 0xaab3,
-    0xccd3, 0x4cd3, 0x2cd3, 0xacd3, 0x34d3, 0xb4d3, 0xd4d3, 0x54d3,
-    0x32d3, 0xb2d3, 0xd2d3, 0x52d3, 0xcad3, 0x4ad3, 0x2ad3, 0xaad3,
-    0x3353, 0xb353, 0xd353, 0x5353, 0xcb53, 0x4b53, 0x2b53, 0xab53,
-    0xcd53, 0x4d53, 0x2d53, 0xad53, 0x3553, 0xb553, 0xd553, 0x5553,
-    0xcccb, 0x4ccb, 0x2ccb, 0xaccb, 0x34cb, 0xb4cb, 0xd4cb, 0x54cb,
-    0x32cb, 0xb2cb, 0xd2cb, 0x52cb, 0xcacb, 0x4acb, 0x2acb, 0xaacb,
-    0x334b, 0xb34b, 0xd34b, 0x534b, 0xcb4b, 0x4b4b, 0x2b4b, 0xab4b,
-    0xcd4b, 0x4d4b, 0x2d4b, 0xad4b, 0x354b, 0xb54b, 0xd54b, 0x554b,
-    0x332b, 0xb32b, 0xd32b, 0x532b, 0xcb2b, 0x4b2b, 0x2b2b, 0xab2b,
-    0xcd2b, 0x4d2b, 0x2d2b, 0xad2b, 0x352b, 0xb52b, 0xd52b, 0x552b,
-    0xccab, 0x4cab, 0x2cab, 0xacab, 0x34ab, 0xb4ab, 0xd4ab, 0x54ab,
-    0x32ab, 0xb2ab, 0xd2ab, 0x52ab, 0xcaab, 0x4aab, 0x2aab, 0xaaab,
-    0xcccd, 0x4ccd, 0x2ccd, 0xaccd, 0x34cd, 0xb4cd, 0xd4cd, 0x54cd,
-    0x32cd, 0xb2cd, 0xd2cd, 0x52cd, 0xcacd, 0x4acd, 0x2acd, 0xaacd,
-    0x334d, 0xb34d, 0xd34d, 0x534d, 0xcb4d, 0x4b4d, 0x2b4d, 0xab4d,
-    0xcd4d, 0x4d4d, 0x2d4d, 0xad4d, 0x354d, 0xb54d, 0xd54d, 0x554d,
-    0x332d, 0xb32d, 0xd32d, 0x532d, 0xcb2d, 0x4b2d, 0x2b2d, 0xab2d,
-    0xcd2d, 0x4d2d, 0x2d2d, 0xad2d, 0x352d, 0xb52d, 0xd52d, 0x552d,
-    0xccad, 0x4cad, 0x2cad, 0xacad, 0x34ad, 0xb4ad, 0xd4ad, 0x54ad,
-    0x32ad, 0xb2ad, 0xd2ad, 0x52ad, 0xcaad, 0x4aad, 0x2aad, 0xaaad,
-    0x3335, 0xb335, 0xd335, 0x5335, 0xcb35, 0x4b35, 0x2b35, 0xab35,
-    0xcd35, 0x4d35, 0x2d35, 0xad35, 0x3535, 0xb535, 0xd535, 0x5535,
-    0xccb5, 0x4cb5, 0x2cb5, 0xacb5, 0x34b5, 0xb4b5, 0xd4b5, 0x54b5,
-    0x32b5, 0xb2b5, 0xd2b5, 0x52b5, 0xcab5, 0x4ab5, 0x2ab5, 0xaab5,
-    0xccd5, 0x4cd5, 0x2cd5, 0xacd5, 0x34d5, 0xb4d5, 0xd4d5, 0x54d5,
-    0x32d5, 0xb2d5, 0xd2d5, 0x52d5, 0xcad5, 0x4ad5, 0x2ad5, 0xaad5,
-    0x3355, 0xb355, 0xd355, 0x5355, 0xcb55, 0x4b55, 0x2b55, 0xab55,
-    0xcd55, 0x4d55, 0x2d55, 0xad55, 0x3555, 0xb555, 0xd555, 0x5555,
-};
-
-// BMC preamble
-#define BMC_B		0x33173333	// block start
-#define BMC_M		0x331d3333	// left ch
-#define BMC_W		0x331b3333	// right ch
-#define BMC_MW_DIF	(BMC_M ^ BMC_W)
-#define SYNC_OFFSET	2		// byte offset of SYNC
-#define SYNC_FLIP	((BMC_B ^ BMC_M) >> (SYNC_OFFSET * 8))
-
-// initialize S/PDIF buffer
-static void spdif_buf_init(void)
+static int spdif_rate;
+static volatile int64_t spdif_write_us;	// end of the last write
+
+// count cleared DMA buffers sent before this write
+static void spdif_count_underruns(int64_t now_us)
+{
+    int64_t buf_us = (int64_t)SPDIF_BUF_FRAMES * 1000000 / spdif_rate;
+    int64_t late_us = now_us - (spdif_write_us + DMA_BUF_COUNT * buf_us);
+
+    // the writing task starts again, e.g. on reconnect with a fixed rate
+    if (late_us > SPDIF_WRITER_IDLE_US && spdif_enc_muted()) {
+	spdif_dma_written = 0;
+	return;
+    }
+    // starting up, the DMA sends cleared buffers until all are written once
+    if (spdif_dma_written > DMA_BUF_COUNT && late_us > 0) {
+	spdif_underruns += late_us / buf_us + 1;
+    }
+}
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// run time of the writing task per frame, in cycles at the current frequency
+static void spdif_count_cycles(void)
 {
-    int i;
-    uint32_t bmc_mw = BMC_W;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    TaskStatus_t status;
 
-    for (i = 0; i < SPDIF_BUF_ARRAY_SIZE; i += 2) {
-	spdif_buf[i] = bmc_mw ^= BMC_MW_DIF;
+    if (task == spdif_stat_task && ++spdif_bufs < SPDIF_STAT_BUFS) {
+	return;
+    }
+    vTaskGetInfo(task, &status, pdFALSE, eRunning);
+    if (task == spdif_stat_task) {
+	spdif_cycles_per_frame_avg = (uint64_t)(status.ulRunTimeCounter - spdif_stat_run_time) *
+	    (esp_clk_cpu_freq() / 1000000) / (SPDIF_STAT_BUFS * SPDIF_BUF_FRAMES);
     }
+    spdif_stat_task = task;
+    spdif_stat_run_time = status.ulRunTimeCounter;
+    spdif_bufs = 0;
+}
+#endif
+
+// send encoded S/PDIF buffer to I2S
+static void spdif_i2s_write(const uint32_t *buf, size_t size)
+{
+    size_t i2s_write_len;
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    spdif_count_cycles();
+#endif
+    _lock_acquire(&spdif_lock);
+    spdif_count_underruns(esp_timer_get_time());
+    i2s_write(I2S_NUM, buf, size, &i2s_write_len, portMAX_DELAY);
+    spdif_dma_written++;
+    spdif_write_us = esp_timer_get_time();
+    _lock_release(&spdif_lock);
+}
+
+/*
+ * Replace the APLL setting found by the driver by the exact one, the
+ * master clock and so the I2S dividers stay the same. The coefficients
+ * are solved for the I2S clock divider the driver sets (N = 1, which
+ * divides by 2), with any other the driver's setting is kept. Revision 0
+ * chips ignore the fractional part (sdm0, sdm1), the driver's setting is
+ * kept.
+ */
+static void spdif_set_apll(uint32_t mclk)
+{
+    uint32_t xtal = rtc_clk_xtal_freq_get() * 1000000;
+    spdif_apll_coef_t coef;
+
+    if (esp_efuse_get_chip_ver() == 0) {
+	ESP_LOGW(SPDIF_TAG, "APLL fraction not available, MCLK %uHz set by driver", mclk);
+	return;
+    }
+    if (I2S0.clkm_conf.clkm_div_num > 1 || I2S0.clkm_conf.clkm_div_a > 1) {
+	ESP_LOGW(SPDIF_TAG, "I2S clock divider %u %u/%u, MCLK %uHz set by driver",
+		 I2S0.clkm_conf.clkm_div_num, I2S0.clkm_conf.clkm_div_b, I2S0.clkm_conf.clkm_div_a, mclk);
+	return;
+    }
+    if (!spdif_apll_get_coef(xtal, mclk, &coef)) {
+	ESP_LOGW(SPDIF_TAG, "no APLL setting for MCLK %uHz, set by driver", mclk);
+	return;
+    }
+    i2s_stop(I2S_NUM);
+    rtc_clk_apll_enable(true, coef.sdm0, coef.sdm1, coef.sdm2, coef.o_div);
+    i2s_start(I2S_NUM);
+    ESP_LOGI(SPDIF_TAG, "APLL sdm %u/%u/%u o_div %u, MCLK %uHz %+dppb",
+	     coef.sdm2, coef.sdm1, coef.sdm0, coef.o_div, mclk, coef.error_ppb);
 }
 
 // initialize I2S for S/PDIF transmission
 void spdif_init(int rate)
 {
     int sample_rate = rate * BMC_BITS_FACTOR;
-    int bclk = sample_rate * I2S_BITS_PER_SAMPLE * I2S_CHANNELS;
-    int mclk = (I2S_BUG_MAGIC / bclk) * bclk; // use mclk for avoiding I2S bug
+    uint32_t mclk = spdif_apll_mclk(rate);
     i2s_config_t i2s_config = {
         .mode = I2S_MODE_MASTER | I2S_MODE_TX,
     	.sample_rate = sample_rate,
@@ -116,43 +194,73 @@ void spdif_init(int rate)
     };
 
     ESP_ERROR_CHECK(i2s_driver_install(I2S_NUM, &i2s_config, 0, NULL));
+    spdif_rate = rate;
+    spdif_write_us = esp_timer_get_time();
+    spdif_dma_written = 0;
     ESP_ERROR_CHECK(i2s_set_pin(I2S_NUM, &pin_config));
+    spdif_set_apll(mclk);
 
-    // initialize S/PDIF buffer
-    spdif_buf_init();
-    spdif_ptr = spdif_buf;
+    // initialize S/PDIF encoder
+    spdif_enc_init(rate, spdif_i2s_write);
 }
 
-// write audio data to I2S buffer
-void spdif_write(const void *src, size_t size)
+// whether a task writes, the DMA sends cleared buffers (silence) otherwise
+static bool spdif_writing(void)
 {
-    const uint8_t *p = src;
+    return esp_timer_get_time() - spdif_write_us < SPDIF_WRITER_IDLE_US;
+}
 
-    while (p < (uint8_t *)src + size) {
+// fade out or in
+void spdif_set_mute(bool mute, bool wait)
+{
+    TickType_t start = xTaskGetTickCount();
 
-	// convert PCM 16bit data to BMC 32bit pulse pattern
-	*(spdif_ptr + 1) = (uint32_t)(((bmc_tab[*p] << 16) ^ bmc_tab[*(p + 1)]) << 1) >> 1;
+    // already silent
+    if (mute && spdif_enc_muted() && !spdif_enc_ramping()) {
+	return;
+    }
+    spdif_enc_set_mute(mute);
 
-	p += 2;
-	spdif_ptr += 2; 	// advance to next audio data
- 
-	if (spdif_ptr >= &spdif_buf[SPDIF_BUF_ARRAY_SIZE]) {
-    	    size_t i2s_write_len;
+    // the writing task runs the ramp, do not wait when nothing is written
+    while (wait && spdif_enc_ramping() && spdif_writing() &&
+	   xTaskGetTickCount() - start < pdMS_TO_TICKS(SPDIF_GAIN_RAMP_MS + 100)) {
+	vTaskDelay(1);
+    }
+}
 
-	    // set block start preamble
-	    ((uint8_t *)spdif_buf)[SYNC_OFFSET] ^= SYNC_FLIP;
+// number of DMA underruns
+uint32_t spdif_get_underruns(void)
+{
+    return spdif_underruns;
+}
 
-	    i2s_write(I2S_NUM, spdif_buf, sizeof(spdif_buf), &i2s_write_len, portMAX_DELAY);
+// measured cost of the output
+uint32_t spdif_get_cycles_per_frame(void)
+{
+    return spdif_cycles_per_frame_avg;
+}
 
-	    spdif_ptr = spdif_buf;
-	}
-    }
+// play time of the next written frame
+int64_t SPDIF_IRAM_ATTR spdif_get_playout_time(void)
+{
+    int64_t frames = DMA_BUF_COUNT * SPDIF_BUF_FRAMES + spdif_enc_pending();
+
+    return spdif_write_us + frames * 1000000 / spdif_rate;
 }
 
 // change S/PDIF sample rate
 void spdif_set_sample_rates(int rate)
 {
+    bool muted = spdif_enc_muted();
+
+    // fade out, the receiver may mute or click while relocking
+    spdif_set_mute(true, true);
+
     // uninstall and reinstall I2S driver for avoiding I2S bug
+    _lock_acquire(&spdif_lock);
     i2s_driver_uninstall(I2S_NUM);
     spdif_init(rate);
+    _lock_release(&spdif_lock);
+
+    spdif_set_mute(muted, false);
 }
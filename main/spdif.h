@@ -6,6 +6,7 @@
     CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/types.h>
 
 /*
@@ -21,6 +22,80 @@ void spdif_init(int rate);
  */
 void spdif_write(const void *src, size_t size);
 
+/*
+ * send silence to S/PDIF transmitter
+ *   fills up the current transmit buffer (half of an S/PDIF block) with
+ *   zero data, keeps the receiver locked while no audio data is available
+ */
+void spdif_write_silence(void);
+
+/*
+ * select non-audio transmission
+ *   nonaudio: true for IEC 61937 data bursts, false for linear PCM
+ *   in non-audio mode every data bit is sent as is and the channel status
+ *   non-audio bit is set, the change takes effect at the next buffer
+ */
+void spdif_set_nonaudio(bool nonaudio);
+
+/*
+ * audio levels of the last transmit buffer (half of an S/PDIF block)
+ */
+typedef struct {
+    uint32_t blocks;		// number of measured buffers since init
+    uint16_t peak[2];		// peak absolute value, left and right
+    uint16_t rms[2];		// RMS value, left and right
+    uint32_t clips[2];		// number of full scale samples since init
+} spdif_levels_t;
+
+/*
+ * get audio levels
+ *   levels: snapshot of the levels measured while encoding
+ *   return: false when level metering is disabled
+ *   may be called from any task, never blocks the S/PDIF output
+ */
+bool spdif_get_levels(spdif_levels_t *levels);
+
+/*
+ * number of DMA buffers sent without new data since init
+ *   counted while writing, e.g. after the writing task was stalled, not
+ *   while no task writes after muting the output
+ */
+uint32_t spdif_get_underruns(void);
+
+/*
+ * measured cost of the output
+ *   return: CPU cycles per stereo frame the writing task ran (DSP, PLC,
+ *           resampling, encoding), from its FreeRTOS run time over about
+ *           1 second, 0 without FREERTOS_GENERATE_RUN_TIME_STATS
+ */
+uint32_t spdif_get_cycles_per_frame(void);
+
+/*
+ * estimated play time of the next written frame
+ *   return: esp_timer_get_time() when the next frame passed to
+ *           spdif_write() leaves the transmitter, assuming that the
+ *           writing task keeps the DMA buffers full
+ */
+int64_t spdif_get_playout_time(void);
+
+#define SPDIF_GAIN_UNITY	32768	// 0dB
+
+/*
+ * set volume
+ *   gain: linear gain, 0 to SPDIF_GAIN_UNITY
+ *   the gain is ramped per sample by the writing task, no click occurs
+ */
+void spdif_set_gain(int gain);
+
+/*
+ * mute or unmute with a fade
+ *   mute: true to fade out, false to fade in
+ *   wait: wait until the fade is done by the writing task,
+ *         returns at once when no task writes or output is already muted
+ *   a fade in is kept until audio data is written
+ */
+void spdif_set_mute(bool mute, bool wait);
+
 /*
  * change sampling rate
  *   rate: sampling rate, 44100Hz, 48000Hz etc.
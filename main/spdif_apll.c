@@ -0,0 +1,106 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * APLL coefficients for S/PDIF transmission
+ *
+ * The I2S driver searches the APLL coefficients one by one (sdm2, o_div,
+ * then sdm1, sdm0), so its output can be several ppm off. Here the
+ * feedback divider is solved exactly for each output divider, the
+ * fraction sdm2 + sdm1 / 2^8 + sdm0 / 2^16 is a single 22 bit number
+ * rounded to 2^-16, and the best output divider is taken. The master
+ * clock is not changed, so the I2S bit clock divider set by the driver
+ * still applies. The driver runs the APLL at twice the master clock, its
+ * I2S clock divider (clkm_div_num 1) divides by 2.
+ *
+ * No ESP-IDF dependency, spdif_tool checks the table on the host.
+ */
+#include <stdlib.h>
+#include "spdif_apll.h"
+
+#define I2S_BITS_PER_SAMPLE	(32)
+#define I2S_CHANNELS		2
+#define BMC_BITS_PER_SAMPLE	64
+#define BMC_BITS_FACTOR		(BMC_BITS_PER_SAMPLE / I2S_BITS_PER_SAMPLE)
+#define I2S_BUG_MAGIC		(26 * 1000 * 1000)	// magic number for avoiding I2S bug
+
+#define APLL_VCO_MIN		(350 * 1000 * 1000)
+#define APLL_VCO_MAX		(500 * 1000 * 1000)
+#define APLL_FRAC_BITS		16
+#define APLL_SDM2_MAX		63
+#define APLL_O_DIV_MAX		31
+
+/*
+ * generated by "spdif_tool apll -t", 40MHz crystal
+ */
+static const spdif_apll_coef_t apll_table[] = {
+    // xtal, mclk, sdm0, sdm1, sdm2, o_div, error_ppb
+    { 40000000, 24576000, 149, 212, 5, 2, -146 },	// 32kHz, 48kHz
+    { 40000000, 22579200, 28, 8, 5, 2, -304 },		// 44.1kHz
+};
+
+// I2S master clock
+uint32_t spdif_apll_mclk(int rate)
+{
+    uint32_t bclk = rate * BMC_BITS_FACTOR * I2S_BITS_PER_SAMPLE * I2S_CHANNELS;
+
+    return (I2S_BUG_MAGIC / bclk) * bclk;	// use mclk for avoiding I2S bug
+}
+
+// best APLL coefficients
+bool spdif_apll_solve(uint32_t xtal, uint32_t mclk, spdif_apll_coef_t *coef)
+{
+    bool found = false;
+
+    for (int o_div = 0; o_div <= APLL_O_DIV_MAX; o_div++) {
+	uint64_t vco = (uint64_t)mclk * SPDIF_APLL_I2S_DIV * 2 * (o_div + 2);
+	uint64_t fb;
+	int64_t diff, error_ppb;
+
+	if (vco < APLL_VCO_MIN || vco > APLL_VCO_MAX) {
+	    continue;
+	}
+	// feedback divider in 2^-16, 4 + sdm2 is the integer part
+	fb = ((vco << APLL_FRAC_BITS) + xtal / 2) / xtal;
+	if (fb < (4ULL << APLL_FRAC_BITS) || fb >= ((5ULL + APLL_SDM2_MAX) << APLL_FRAC_BITS)) {
+	    continue;
+	}
+	diff = (int64_t)(fb * xtal) - (int64_t)(vco << APLL_FRAC_BITS);
+	error_ppb = diff * 1000000000 / (int64_t)(vco << APLL_FRAC_BITS);
+	if (!found || llabs(error_ppb) < llabs(coef->error_ppb)) {
+	    found = true;
+	    coef->xtal = xtal;
+	    coef->mclk = mclk;
+	    coef->sdm0 = fb & 0xff;
+	    coef->sdm1 = (fb >> 8) & 0xff;
+	    coef->sdm2 = (fb >> APLL_FRAC_BITS) - 4;
+	    coef->o_div = o_div;
+	    coef->error_ppb = error_ppb;
+	}
+    }
+    return found;
+}
+
+// table lookup
+bool spdif_apll_get_coef(uint32_t xtal, uint32_t mclk, spdif_apll_coef_t *coef)
+{
+    for (size_t i = 0; i < sizeof(apll_table) / sizeof(apll_table[0]); i++) {
+	if (apll_table[i].xtal == xtal && apll_table[i].mclk == mclk) {
+	    *coef = apll_table[i];
+	    return true;
+	}
+    }
+    return spdif_apll_solve(xtal, mclk, coef);
+}
+
+// precomputed table
+const spdif_apll_coef_t *spdif_apll_table(int *count)
+{
+    *count = sizeof(apll_table) / sizeof(apll_table[0]);
+    return apll_table;
+}
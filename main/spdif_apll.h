@@ -0,0 +1,64 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __SPDIF_APLL_H__
+#define __SPDIF_APLL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPDIF_APLL_MAX_PPB	500	// worst error of the table, 0.5ppm
+#define SPDIF_APLL_I2S_DIV	2	// I2S clock divider set by the driver (clkm_div_num 1)
+
+/*
+ * APLL coefficients
+ *   output = xtal * (4 + sdm2 + sdm1 / 2^8 + sdm0 / 2^16) / (2 * (o_div + 2))
+ *   mclk = output / SPDIF_APLL_I2S_DIV
+ */
+typedef struct {
+    uint32_t xtal;		// crystal frequency in Hz
+    uint32_t mclk;		// wanted I2S master clock in Hz
+    uint8_t sdm0;
+    uint8_t sdm1;
+    uint8_t sdm2;
+    uint8_t o_div;
+    int32_t error_ppb;		// output frequency error in 10^-9
+} spdif_apll_coef_t;
+
+/*
+ * I2S master clock for S/PDIF transmission
+ *   rate: sampling rate, 44100Hz, 48000Hz etc.
+ *   return: the master clock, an integer multiple of the bit clock (the
+ *           I2S bug is avoided below 26MHz), the APLL runs at
+ *           SPDIF_APLL_I2S_DIV times this
+ */
+uint32_t spdif_apll_mclk(int rate);
+
+/*
+ * search all APLL coefficients for the smallest error
+ *   xtal: crystal frequency in Hz
+ *   mclk: wanted I2S master clock in Hz
+ *   coef: result
+ *   return: false when no setting is in the APLL's range
+ */
+bool spdif_apll_solve(uint32_t xtal, uint32_t mclk, spdif_apll_coef_t *coef);
+
+/*
+ * get APLL coefficients
+ *   the precomputed table for 32kHz, 44.1kHz and 48kHz with a 40MHz
+ *   crystal is used, other settings are solved
+ *   return: false when no setting is in the APLL's range
+ */
+bool spdif_apll_get_coef(uint32_t xtal, uint32_t mclk, spdif_apll_coef_t *coef);
+
+/*
+ * precomputed table
+ *   count: number of entries
+ */
+const spdif_apll_coef_t *spdif_apll_table(int *count);
+
+#endif /* __SPDIF_APLL_H__ */
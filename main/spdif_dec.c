@@ -0,0 +1,401 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdbool.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+#include "spdif_enc.h"
+#include "spdif_dec.h"
+
+/*
+ * S/PDIF decoder, independent of the platform. The input is the S/PDIF
+ * signal sampled at a fixed rate a few times the half bit rate. The
+ * transitions of a 32 sample word are found at once, and only the
+ * distances between transitions are looked at: a table classifies them
+ * as 1, 2 or 3 half bits. The transitions of a subframe are collected
+ * in a 64bit register, one bit per half bit boundary, which is checked
+ * and converted to data bits with word-parallel masks.
+ *
+ * Transition register of a subframe, bit n is the transition after
+ * half bit n (first half bit in LSb):
+ *   bits 0-6	inside the preamble
+ *   odd bits 7-63	start of each time slot, always 1 (BMC clock)
+ *   even bits 8-62	middle of time slots 4-31, set for data 1
+ */
+#define DEC_MAX_RUN		64	// longest run in samples
+#define DEC_TRAIN_RUNS		2048	// runs to estimate the half bit length
+#define DEC_LOCK_BLOCKS		2	// good blocks before locked
+#define DEC_UNLOCK_ERRORS	16	// errors in a block to lose lock
+#define DEC_UNLOCK_SAMPLES	(1 << 16)	// no transition for this long to lose lock
+#define DEC_NO_SYNC		0x10000	// half bit count while out of sync
+
+#define DEC_CLOCK_MASK		0xaaaaaaaaaaaaaa80ULL
+#define DEC_PRE_MASK		0x7f
+#define DEC_PRE_B		0x1c	// 11101000
+#define DEC_PRE_M		0x64	// 11100010
+#define DEC_PRE_W		0x34	// 11100100
+
+#define DEC_BLOCK_FRAMES	192
+#define DEC_HALF_BITS		(DEC_BLOCK_FRAMES * 2 * 64)	// per block
+
+static const uint32_t dec_rates[] = { 32000, 44100, 48000, 88200, 96000 };
+
+static uint32_t dec_sample_rate;
+static spdif_dec_output_t dec_output;
+
+// sampling
+static uint8_t SPDIF_DRAM_ATTR dec_run_tab[DEC_MAX_RUN];	// samples -> half bits
+static bool dec_trained;
+static uint32_t dec_train_hist[DEC_MAX_RUN];
+static uint32_t dec_train_runs;
+static uint32_t dec_last;		// last sample of the previous word
+static uint32_t dec_pos;		// sample position of the next word
+static uint32_t dec_edge;		// sample position of the last transition
+
+// subframe
+static uint64_t dec_trans;		// transition register
+static uint32_t dec_count;		// half bits in the register
+static uint32_t dec_start;		// sample position of the subframe
+
+// block
+static int dec_frame;			// frame in the block, -1 before the first B
+static uint32_t dec_block_start;
+static uint8_t dec_cs[24];
+static int dec_good_blocks;
+static uint32_t dec_block_errors;
+static bool dec_locked;
+static int16_t dec_left;
+static int16_t dec_pcm[SPDIF_DEC_PCM_FRAMES * 2];
+static int dec_pcm_frames;
+
+static spdif_dec_status_t dec_status;
+static spdif_dec_status_t dec_status_pub;
+static volatile uint32_t dec_status_seq;	// odd while publishing
+
+// publish status per block, a reader retries while seq is odd or changed
+static void dec_publish(void)
+{
+    dec_status.locked = dec_locked;
+    dec_status_seq++;
+    __sync_synchronize();
+    dec_status_pub = dec_status;
+    __sync_synchronize();
+    dec_status_seq++;
+}
+
+/*
+ * classify runs by the half bit length in 1/256 samples, invalid runs
+ * are taken as 4 half bits: BMC has no such run, so the subframe fails
+ * the clock check
+ */
+static void dec_make_tab(uint32_t half256)
+{
+    for (uint32_t n = 0; n < DEC_MAX_RUN; n++) {
+	uint32_t half_bits = (n * 512 + half256) / (half256 * 2);
+
+	dec_run_tab[n] = (half_bits >= 1 && half_bits <= 3) ? half_bits : 4;
+    }
+    dec_run_tab[DEC_MAX_RUN - 1] = 4;	// and longer
+}
+
+// start over with the estimation of the half bit length
+static void dec_unlock(void)
+{
+    if (dec_locked) {
+	dec_status.unlocks++;
+    }
+    dec_locked = false;
+    dec_trained = false;
+    dec_count = DEC_NO_SYNC;
+    dec_frame = -1;
+    dec_good_blocks = 0;
+    dec_block_errors = 0;
+    dec_pcm_frames = 0;
+    dec_publish();
+}
+
+/*
+ * estimate the half bit length: the length in 1/16 samples at which
+ * most runs are close to 1, 2 or 3 half bits (silence has no data 1,
+ * so the most common run is not always a single half bit); it is
+ * refined by the block length once blocks are decoded
+ */
+static void dec_train(uint32_t n)
+{
+    uint32_t best = 0, best_sum = 0, best_half_bits = 0;
+
+    if (n < DEC_MAX_RUN) {
+	dec_train_hist[n]++;
+    }
+    if (++dec_train_runs < DEC_TRAIN_RUNS) {
+	return;
+    }
+    for (uint32_t half16 = 40; half16 * 7 < DEC_MAX_RUN * 32; half16++) {
+	uint32_t score = 0, sum = 0, half_bits = 0;
+
+	for (n = 1; n < DEC_MAX_RUN; n++) {
+	    uint32_t k = (n * 32 + half16) / (half16 * 2);
+	    int32_t d = n * 16 - k * half16;
+
+	    if (k >= 1 && k <= 3 && (d < 0 ? -d : d) * 10 < (int32_t)half16 * 3) {
+		score += dec_train_hist[n];
+		sum += dec_train_hist[n] * n;
+		half_bits += dec_train_hist[n] * k;
+	    }
+	}
+	if (score > best) {
+	    best = score;
+	    best_sum = sum;
+	    best_half_bits = half_bits;
+	}
+    }
+    dec_train_runs = 0;
+    memset(dec_train_hist, 0, sizeof(dec_train_hist));
+    if (best < DEC_TRAIN_RUNS * 9 / 10) {
+	return;			// no signal, or less than 2.5 samples per half bit
+    }
+    dec_make_tab((uint64_t)best_sum * 256 / best_half_bits);
+    dec_trained = true;
+}
+
+// end of block, B preamble at sample position start
+static void dec_block(uint32_t start)
+{
+    uint32_t samples = start - dec_block_start;
+    uint32_t rate;
+    int nominal = 0;
+
+    dec_block_start = start;
+    if (dec_frame != DEC_BLOCK_FRAMES) {
+	dec_good_blocks = 0;
+	return;
+    }
+
+    // refine the half bit length, measure the sampling rate
+    dec_make_tab(((uint64_t)samples * 256 + DEC_HALF_BITS / 2) / DEC_HALF_BITS);
+    rate = ((uint64_t)dec_sample_rate * DEC_BLOCK_FRAMES + samples / 2) / samples;
+    for (size_t i = 0; i < sizeof(dec_rates) / sizeof(dec_rates[0]); i++) {
+	if (rate > dec_rates[i] - dec_rates[i] / 200 && rate < dec_rates[i] + dec_rates[i] / 200) {
+	    nominal = dec_rates[i];
+	}
+    }
+
+    if (dec_block_errors >= DEC_UNLOCK_ERRORS) {
+	dec_good_blocks = 0;
+    } else if (dec_good_blocks < DEC_LOCK_BLOCKS) {
+	dec_good_blocks++;
+    }
+
+    dec_locked = (dec_good_blocks >= DEC_LOCK_BLOCKS);
+    dec_status.rate = nominal;
+    dec_status.measured_rate = rate;
+    dec_status.nonaudio = (dec_cs[0] >> 1) & 1;
+    memcpy(dec_status.cstatus, dec_cs, sizeof(dec_cs));
+    dec_publish();
+    dec_block_errors = 0;
+}
+
+// a subframe is lost
+static void dec_error(void)
+{
+    dec_status.errors++;
+    if (++dec_block_errors >= DEC_UNLOCK_ERRORS && dec_locked) {
+	dec_unlock();
+    }
+}
+
+// gather even bits, 32 -> 16
+static inline uint32_t dec_even_bits(uint32_t v)
+{
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    return (v | (v >> 8)) & 0x0000ffff;
+}
+
+// decode a complete subframe
+static SPDIF_IRAM_ATTR void dec_subframe(uint64_t trans, uint32_t start)
+{
+    uint32_t pre = trans & DEC_PRE_MASK;
+    uint32_t data;
+
+    if ((trans & DEC_CLOCK_MASK) != DEC_CLOCK_MASK) {
+	goto error;
+    }
+
+    // time slots 4-31, LSb first: aux and audio (24), V, U, C, P
+    data = dec_even_bits(trans >> 8) | (dec_even_bits(trans >> 40) << 16);
+    if (__builtin_parity(data)) {
+	goto error;
+    }
+
+    if (pre == DEC_PRE_W) {
+	if (dec_frame < 0 || dec_frame >= DEC_BLOCK_FRAMES) {
+	    return;
+	}
+	dec_frame++;
+	if (dec_locked) {
+	    dec_pcm[dec_pcm_frames * 2] = dec_left;
+	    dec_pcm[dec_pcm_frames * 2 + 1] = data >> 8;
+	    if (++dec_pcm_frames == SPDIF_DEC_PCM_FRAMES && dec_output) {
+		dec_output(dec_pcm, SPDIF_DEC_PCM_FRAMES);
+		dec_pcm_frames = 0;
+	    }
+	    dec_status.frames++;
+	}
+	return;
+    }
+    if (pre == DEC_PRE_B) {
+	if (dec_frame >= 0) {
+	    dec_block(start);
+	} else {
+	    dec_block_start = start;
+	}
+	dec_frame = 0;
+	memset(dec_cs, 0, sizeof(dec_cs));
+    } else if (pre != DEC_PRE_M) {
+	goto error;
+    }
+    if (dec_frame >= 0 && dec_frame < DEC_BLOCK_FRAMES) {
+	dec_cs[dec_frame >> 3] |= ((data >> 26) & 1) << (dec_frame & 7);
+    }
+    dec_left = data >> 8;
+    return;
+
+error:
+    dec_error();
+}
+
+// collect runs to estimate the half bit length, return words used
+static size_t dec_train_words(const uint32_t *words, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count && !dec_trained; i++) {
+	uint32_t w = words[i];
+	uint32_t t = w ^ ((w >> 1) | (dec_last << 31));
+
+	dec_last = w & 1;
+	while (t) {
+	    uint32_t z = __builtin_clz(t);
+
+	    dec_train(dec_pos + z - dec_edge);
+	    dec_edge = dec_pos + z;
+	    t &= ~(0x80000000 >> z);
+	}
+	dec_pos += 32;
+    }
+    return i;
+}
+
+/*
+ * decode words while trained, return words used
+ *
+ * Per transition: count leading zeros, table lookup of the run length,
+ * shift the transition into the register from the top. The state is
+ * kept in local variables, only a preamble leaves the loop; a subframe
+ * is complete when the preamble comes after exactly 64 half bits.
+ */
+static SPDIF_IRAM_ATTR size_t dec_decode_words(const uint32_t *words, size_t count)
+{
+    const uint8_t *tab = dec_run_tab;
+    uint64_t trans = dec_trans;
+    uint32_t half = dec_count;
+    uint32_t last = dec_last;
+    uint32_t pos = dec_pos;
+    uint32_t edge = dec_edge;
+    size_t i;
+
+    for (i = 0; i < count; ) {
+	uint32_t w = words[i++];
+	uint32_t t = w ^ ((w >> 1) | (last << 31));	// transition before each sample
+
+	last = w & 1;
+	while (t) {
+	    uint32_t z = __builtin_clz(t);
+	    uint32_t n = pos + z - edge;
+	    uint32_t half_bits = tab[n < DEC_MAX_RUN ? n : DEC_MAX_RUN - 1];
+
+	    t &= ~(0x80000000 >> z);
+	    if (half_bits == 3 && half >= 8) {
+		// preamble of the next subframe
+		if (half == 64) {
+		    dec_subframe(trans, dec_start);
+		} else if (half < DEC_NO_SYNC) {
+		    dec_error();
+		}
+		if (!dec_trained) {
+		    goto unlocked;
+		}
+		dec_start = edge;
+		half = 0;
+	    }
+	    half += half_bits;
+	    trans = (trans >> half_bits) | (1ULL << 63);
+	    edge = pos + z;
+	}
+	pos += 32;
+	continue;
+
+unlocked:
+	pos += 32;		// rest of the word is not used for training
+	break;
+    }
+
+    dec_trans = trans;
+    dec_count = dec_trained ? half : DEC_NO_SYNC;
+    dec_last = last;
+    dec_pos = pos;
+    dec_edge = edge;
+    return i;
+}
+
+// initialize decoder
+void spdif_dec_init(uint32_t sample_rate, spdif_dec_output_t output)
+{
+    dec_sample_rate = sample_rate;
+    dec_output = output;
+    dec_last = 0;
+    dec_pos = dec_edge = 0;
+    memset(&dec_status, 0, sizeof(dec_status));
+    dec_unlock();
+}
+
+// decode sampled S/PDIF signal
+void SPDIF_IRAM_ATTR spdif_dec_process(const uint32_t *words, size_t count)
+{
+    size_t i = 0;
+
+    while (i < count) {
+	if (dec_trained) {
+	    i += dec_decode_words(words + i, count - i);
+	} else {
+	    i += dec_train_words(words + i, count - i);
+	}
+    }
+
+    // signal lost
+    if ((dec_locked || dec_trained) && dec_pos - dec_edge > DEC_UNLOCK_SAMPLES) {
+	dec_unlock();
+    }
+}
+
+// get receiver status
+void spdif_dec_get_status(spdif_dec_status_t *status)
+{
+    uint32_t seq;
+
+    do {
+	seq = dec_status_seq;
+	__sync_synchronize();
+	*status = dec_status_pub;
+	__sync_synchronize();
+    } while ((seq & 1) || seq != dec_status_seq);
+}
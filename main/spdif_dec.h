@@ -0,0 +1,56 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __SPDIF_DEC_H__
+#define __SPDIF_DEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define SPDIF_DEC_PCM_FRAMES	96	// stereo frames per output call
+
+/*
+ * output function, called with decoded 16bit PCM stereo data
+ *   pcm: audio data
+ *   frames: number of stereo frames, SPDIF_DEC_PCM_FRAMES
+ */
+typedef void (*spdif_dec_output_t)(const int16_t *pcm, size_t frames);
+
+typedef struct {
+    bool locked;		// receiving valid blocks
+    int rate;			// nominal sampling rate, 0 if unknown
+    uint32_t measured_rate;	// measured sampling rate in Hz
+    bool nonaudio;		// channel status non-audio bit
+    uint8_t cstatus[24];	// channel status block of the left channel
+    uint32_t frames;		// decoded frames
+    uint32_t errors;		// subframes lost by coding or parity errors
+    uint32_t unlocks;		// number of lock losses
+} spdif_dec_status_t;
+
+/*
+ * initialize decoder
+ *   sample_rate: rate of the input samples in Hz, at least 2.5 samples
+ *                per half bit (e.g. 20MHz for up to 48kHz)
+ *   output: called with decoded audio data while locked, or NULL
+ */
+void spdif_dec_init(uint32_t sample_rate, spdif_dec_output_t output);
+
+/*
+ * decode sampled S/PDIF signal
+ *   words: 32 samples per word, first sample in MSb
+ *   count: number of words
+ */
+void spdif_dec_process(const uint32_t *words, size_t count);
+
+/*
+ * get receiver status
+ *   a consistent snapshot, can be called from any task
+ */
+void spdif_dec_get_status(spdif_dec_status_t *status);
+
+#endif /* __SPDIF_DEC_H__ */
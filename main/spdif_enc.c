@@ -0,0 +1,548 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+#include "spdif.h"
+#include "spdif_enc.h"
+#ifdef CONFIG_SPDIF_TAP
+#include "pcm_tap.h"
+#endif
+
+/*
+ * S/PDIF encoder, independent of the platform. Each S/PDIF subframe
+ * is two 32bit I2S words of BMC pulses, the output buffer is half of
+ * an S/PDIF block and is passed to the output function when full.
+ */
+
+#define SPDIF_BUF_ARRAY_SIZE	(SPDIF_BUF_SIZE / sizeof(uint32_t))
+#define SPDIF_PCM_BUF_SIZE	(SPDIF_BUF_ARRAY_SIZE / 2 * sizeof(int16_t))	// PCM bytes per buffer
+
+static uint32_t spdif_buf[SPDIF_BUF_ARRAY_SIZE];
+static uint32_t *spdif_ptr;
+static spdif_enc_output_t spdif_output;
+
+#ifdef CONFIG_SPDIF_SILENCE_CACHE
+static uint32_t spdif_silence_buf[SPDIF_BUF_ARRAY_SIZE];
+#endif
+
+#ifdef CONFIG_SPDIF_TAP
+// PCM data of spdif_buf after the gain, passed to the tap at flush
+static int16_t spdif_tap_pcm[SPDIF_BUF_ARRAY_SIZE / 2];
+#define SPDIF_TAP(s)	(spdif_tap_pcm[(spdif_ptr - spdif_buf) / 2] = (s))
+#else
+#define SPDIF_TAP(s)
+#endif
+
+
+/*
+ * 8bit PCM to 16bit BMC conversion table, LSb first, 1 end
+ */
+static const int16_t SPDIF_DRAM_ATTR bmc_tab[256] = {
+    0x3333, 0xb333, 0xd333, 0x5333, 0xcb33, 0x4b33, 0x2b33, 0xab33,
+    0xcd33, 0x4d33, 0x2d33, 0xad33, 0x3533, 0xb533, 0xd533, 0x5533,
+    0xccb3, 0x4cb3, 0x2cb3, 0xacb3, 0x34b3, 0xb4b3, 0xd4b3, 0x54b3,
+    0x32b3, 0xb2b3, 0xd2b3, 0x52b3, 0xcab3, 0x4ab3, 0x2ab3, 0xaab3,
+    0xccd3, 0x4cd3, 0x2cd3, 0xacd3, 0x34d3, 0xb4d3, 0xd4d3, 0x54d3,
+    0x32d3, 0xb2d3, 0xd2d3, 0x52d3, 0xcad3, 0x4ad3, 0x2ad3, 0xaad3,
+    0x3353, 0xb353, 0xd353, 0x5353, 0xcb53, 0x4b53, 0x2b53, 0xab53,
+    0xcd53, 0x4d53, 0x2d53, 0xad53, 0x3553, 0xb553, 0xd553, 0x5553,
+    0xcccb, 0x4ccb, 0x2ccb, 0xaccb, 0x34cb, 0xb4cb, 0xd4cb, 0x54cb,
+    0x32cb, 0xb2cb, 0xd2cb, 0x52cb, 0xcacb, 0x4acb, 0x2acb, 0xaacb,
+    0x334b, 0xb34b, 0xd34b, 0x534b, 0xcb4b, 0x4b4b, 0x2b4b, 0xab4b,
+    0xcd4b, 0x4d4b, 0x2d4b, 0xad4b, 0x354b, 0xb54b, 0xd54b, 0x554b,
+    0x332b, 0xb32b, 0xd32b, 0x532b, 0xcb2b, 0x4b2b, 0x2b2b, 0xab2b,
+    0xcd2b, 0x4d2b, 0x2d2b, 0xad2b, 0x352b, 0xb52b, 0xd52b, 0x552b,
+    0xccab, 0x4cab, 0x2cab, 0xacab, 0x34ab, 0xb4ab, 0xd4ab, 0x54ab,
+    0x32ab, 0xb2ab, 0xd2ab, 0x52ab, 0xcaab, 0x4aab, 0x2aab, 0xaaab,
+    0xcccd, 0x4ccd, 0x2ccd, 0xaccd, 0x34cd, 0xb4cd, 0xd4cd, 0x54cd,
+    0x32cd, 0xb2cd, 0xd2cd, 0x52cd, 0xcacd, 0x4acd, 0x2acd, 0xaacd,
+    0x334d, 0xb34d, 0xd34d, 0x534d, 0xcb4d, 0x4b4d, 0x2b4d, 0xab4d,
+    0xcd4d, 0x4d4d, 0x2d4d, 0xad4d, 0x354d, 0xb54d, 0xd54d, 0x554d,
+    0x332d, 0xb32d, 0xd32d, 0x532d, 0xcb2d, 0x4b2d, 0x2b2d, 0xab2d,
+    0xcd2d, 0x4d2d, 0x2d2d, 0xad2d, 0x352d, 0xb52d, 0xd52d, 0x552d,
+    0xccad, 0x4cad, 0x2cad, 0xacad, 0x34ad, 0xb4ad, 0xd4ad, 0x54ad,
+    0x32ad, 0xb2ad, 0xd2ad, 0x52ad, 0xcaad, 0x4aad, 0x2aad, 0xaaad,
+    0x3335, 0xb335, 0xd335, 0x5335, 0xcb35, 0x4b35, 0x2b35, 0xab35,
+    0xcd35, 0x4d35, 0x2d35, 0xad35, 0x3535, 0xb535, 0xd535, 0x5535,
+    0xccb5, 0x4cb5, 0x2cb5, 0xacb5, 0x34b5, 0xb4b5, 0xd4b5, 0x54b5,
+    0x32b5, 0xb2b5, 0xd2b5, 0x52b5, 0xcab5, 0x4ab5, 0x2ab5, 0xaab5,
+    0xccd5, 0x4cd5, 0x2cd5, 0xacd5, 0x34d5, 0xb4d5, 0xd4d5, 0x54d5,
+    0x32d5, 0xb2d5, 0xd2d5, 0x52d5, 0xcad5, 0x4ad5, 0x2ad5, 0xaad5,
+    0x3355, 0xb355, 0xd355, 0x5355, 0xcb55, 0x4b55, 0x2b55, 0xab55,
+    0xcd55, 0x4d55, 0x2d55, 0xad55, 0x3555, 0xb555, 0xd555, 0x5555,
+};
+
+// BMC preamble
+#define BMC_B		0x33173333	// block start
+#define BMC_M		0x331d3333	// left ch
+#define BMC_W		0x331b3333	// right ch
+#define BMC_MW_DIF	(BMC_M ^ BMC_W)
+#define SYNC_OFFSET	2		// byte offset of SYNC
+#define SYNC_FLIP	((BMC_B ^ BMC_M) >> (SYNC_OFFSET * 8))
+#define SYNC_M		((uint8_t)(BMC_M >> (SYNC_OFFSET * 8)))
+
+// BMC pattern of 16bit zero PCM data
+#define BMC_ZERO	0x33333333
+
+// V, U, C, P bits of the previous subframe, located before the preamble
+#define VUCP_OFFSET	3		// byte offset of VUCP
+#define BMC_VUCP	0x33		// V = U = C = P = 0
+
+// channel status bit 1 (non-audio) is sent in frame 1 of the block
+#define CS_NONAUDIO_FRAME	1
+
+/*
+ * VUCP pattern for non-audio data, indexed by data parity and C bit.
+ * Inverted data with odd parity ends low, so V starts high. P makes
+ * the subframe even parity, so the preamble always starts low.
+ */
+static const uint8_t SPDIF_DRAM_ATTR bmc_vucp_tab[2][2] = {
+    { 0x33, 0x35 },	// even parity: C = 0, C = 1
+    { 0xcd, 0xcb },	// odd parity:  C = 0, C = 1
+};
+
+static bool spdif_nonaudio;		// current mode
+static bool spdif_nonaudio_req;		// requested mode, applied at buffer boundary
+static uint8_t spdif_vucp = BMC_VUCP;	// VUCP of the last encoded subframe
+static uint8_t spdif_carry[2];		// 16bit data split between writes
+static bool spdif_carried;		// spdif_carry[0] waits for its second byte
+
+/*
+ * Gain ramp. The gain is SPDIF_GAIN_UNITY (Q15) shifted left by
+ * SPDIF_GAIN_FRAC bits and stepped once per frame towards the target.
+ * Requests from other tasks are taken by the encoder at the next write.
+ */
+#define SPDIF_GAIN_FRAC		15
+#define SPDIF_GAIN_FULL		(SPDIF_GAIN_UNITY << SPDIF_GAIN_FRAC)
+
+static int32_t spdif_gain = SPDIF_GAIN_FULL;	// current gain
+static int32_t spdif_gain_target = SPDIF_GAIN_FULL;
+static volatile int32_t spdif_gain_step;	// per frame, 0 when not ramping
+static volatile int32_t spdif_gain_req;		// requested target gain
+static volatile bool spdif_gain_update;
+static int spdif_volume = SPDIF_GAIN_UNITY;
+static bool spdif_muted;
+static int spdif_rate = 44100;
+
+#ifdef CONFIG_SPDIF_LEVEL_METER
+typedef struct {
+    uint32_t peak[2];
+    uint64_t sumsq[2];
+    uint32_t clips[2];
+} spdif_meter_t;
+
+static spdif_meter_t spdif_meter;		// accumulated while encoding
+static spdif_meter_t spdif_meter_pub;		// published at flush
+static volatile uint32_t spdif_meter_seq;	// odd while publishing
+#endif
+
+// initialize S/PDIF buffer
+static void spdif_buf_init(void)
+{
+    int i;
+    uint32_t bmc_mw = BMC_W;
+
+    for (i = 0; i < SPDIF_BUF_ARRAY_SIZE; i += 2) {
+	spdif_buf[i] = bmc_mw ^= BMC_MW_DIF;
+#ifdef CONFIG_SPDIF_SILENCE_CACHE
+	spdif_silence_buf[i] = spdif_buf[i];
+	spdif_silence_buf[i + 1] = BMC_ZERO;
+#endif
+    }
+    spdif_vucp = BMC_VUCP;
+#ifdef CONFIG_SPDIF_LEVEL_METER
+    memset(&spdif_meter, 0, sizeof(spdif_meter));
+#endif
+}
+
+// switch between audio and non-audio mode
+static void SPDIF_IRAM_ATTR spdif_set_mode(bool nonaudio)
+{
+    int i;
+
+    // restore VUCP after non-audio data, except the one still to be sent
+    for (i = 2; i < SPDIF_BUF_ARRAY_SIZE; i += 2) {
+	((uint8_t *)&spdif_buf[i])[VUCP_OFFSET] = BMC_VUCP;
+    }
+    if (!nonaudio) {
+	spdif_vucp = BMC_VUCP;
+    }
+    spdif_nonaudio = nonaudio;
+}
+
+// initialize encoder
+void spdif_enc_init(int rate, spdif_enc_output_t output)
+{
+    spdif_rate = rate;
+    spdif_output = output;
+
+    // initialize S/PDIF buffer
+    spdif_buf_init();
+    spdif_ptr = spdif_buf;
+    spdif_carried = false;
+    if (spdif_nonaudio != spdif_nonaudio_req) {
+	spdif_set_mode(spdif_nonaudio_req);
+    }
+}
+
+// take requested gain, ramp to it over SPDIF_GAIN_RAMP_MS
+static void SPDIF_IRAM_ATTR spdif_gain_apply(void)
+{
+    int frames = spdif_rate * SPDIF_GAIN_RAMP_MS / 1000;
+    int32_t step;
+
+    spdif_gain_update = false;
+    __sync_synchronize();
+    spdif_gain_target = spdif_gain_req << SPDIF_GAIN_FRAC;
+
+    step = (spdif_gain_target - spdif_gain) / (frames > 0 ? frames : 1);
+    if (step == 0 || spdif_nonaudio) {
+	spdif_gain = spdif_gain_target;	// non-audio data is never scaled
+    }
+    spdif_gain_step = (spdif_gain == spdif_gain_target) ? 0 : step;
+}
+
+// advance gain ramp by frames
+static int32_t SPDIF_IRAM_ATTR spdif_gain_ramp(int32_t gain, int32_t step, int frames)
+{
+    gain += step * frames;
+    if ((step > 0) ? (gain >= spdif_gain_target) : (gain <= spdif_gain_target)) {
+	gain = spdif_gain_target;
+	spdif_gain_step = 0;
+    }
+    return gain;
+}
+
+// audio data is not sent, a fade in is kept for the next audio data
+static void SPDIF_IRAM_ATTR spdif_gain_skip(void)
+{
+    if (spdif_gain_step < 0) {
+	spdif_gain = spdif_gain_target;
+	spdif_gain_step = 0;
+    }
+}
+
+#ifdef CONFIG_SPDIF_LEVEL_METER
+// accumulate level of one 16bit sample
+static inline void spdif_meter_sample(int ch, int32_t s)
+{
+    uint32_t a = (s < 0) ? -s : s;
+
+    if (a > spdif_meter.peak[ch]) {
+	spdif_meter.peak[ch] = a;
+    }
+    if (a >= INT16_MAX) {
+	spdif_meter.clips[ch]++;
+    }
+    spdif_meter.sumsq[ch] += (uint32_t)(s * s);
+}
+
+// publish levels of the buffer, a reader retries while seq is odd or changed
+static void SPDIF_IRAM_ATTR spdif_meter_publish(void)
+{
+    spdif_meter_seq++;
+    __sync_synchronize();
+    spdif_meter_pub = spdif_meter;
+    __sync_synchronize();
+    spdif_meter_seq++;
+
+    // clip count is kept
+    spdif_meter.peak[0] = spdif_meter.peak[1] = 0;
+    spdif_meter.sumsq[0] = spdif_meter.sumsq[1] = 0;
+}
+#endif
+
+// send S/PDIF buffer to the output
+static void SPDIF_IRAM_ATTR spdif_flush(const uint32_t *buf)
+{
+#ifdef CONFIG_SPDIF_LEVEL_METER
+    spdif_meter_publish();
+#endif
+
+#ifdef CONFIG_SPDIF_TAP
+    pcm_tap_put(buf == spdif_buf ? spdif_tap_pcm : NULL, spdif_rate, spdif_nonaudio ? PCM_TAP_NONAUDIO : 0);
+#endif
+
+    // set block start preamble
+    ((uint8_t *)spdif_buf)[SYNC_OFFSET] ^= SYNC_FLIP;
+#ifdef CONFIG_SPDIF_SILENCE_CACHE
+    if (buf == spdif_silence_buf) {
+	spdif_silence_buf[0] = spdif_buf[0];
+    }
+#endif
+
+    spdif_output(buf, sizeof(spdif_buf));
+
+    // VUCP of the last subframe is sent in front of the next buffer
+    ((uint8_t *)spdif_buf)[VUCP_OFFSET] = spdif_vucp;
+
+    if (spdif_nonaudio != spdif_nonaudio_req) {
+	spdif_set_mode(spdif_nonaudio_req);
+    }
+    spdif_ptr = spdif_buf;
+}
+
+#ifdef CONFIG_SPDIF_SILENCE_CACHE
+// check whether PCM data is all zero
+static bool SPDIF_IRAM_ATTR spdif_is_silent(const uint8_t *p, size_t size)
+{
+    const uint32_t *w = (const uint32_t *)p;
+
+    if ((uintptr_t)p & (sizeof(uint32_t) - 1)) {
+	return false;
+    }
+    for (size /= sizeof(uint32_t); size > 0; size--) {
+	if (*w++) {
+	    return false;
+	}
+    }
+    return true;
+}
+#endif
+
+// number of 16bit data to be encoded into the rest of S/PDIF buffer
+static size_t SPDIF_IRAM_ATTR spdif_encode_count(const uint8_t *p, const uint8_t *end)
+{
+    size_t n = (&spdif_buf[SPDIF_BUF_ARRAY_SIZE] - spdif_ptr) / 2;
+
+    return ((end - p) / 2 < n) ? (end - p) / 2 : n;
+}
+
+// encode audio data, the LSb of odd parity data is flipped for even parity
+static SPDIF_IRAM_ATTR const uint8_t *spdif_encode(const uint8_t *p, const uint8_t *end)
+{
+#ifdef CONFIG_SPDIF_LEVEL_METER
+    int ch = ((spdif_ptr - spdif_buf) / 2) & 1;
+#endif
+
+    for (size_t n = spdif_encode_count(p, end); n > 0; n--) {
+
+	// convert PCM 16bit data to BMC 32bit pulse pattern
+	*(spdif_ptr + 1) = (uint32_t)(((bmc_tab[*p] << 16) ^ bmc_tab[*(p + 1)]) << 1) >> 1;
+	SPDIF_TAP(*p | (*(p + 1) << 8));
+
+#ifdef CONFIG_SPDIF_LEVEL_METER
+	spdif_meter_sample(ch, (int16_t)(*p | (*(p + 1) << 8)));
+	ch ^= 1;
+#endif
+
+	p += 2;
+	spdif_ptr += 2; 	// advance to next audio data
+    }
+    return p;
+}
+
+// encode audio data with gain, the gain is ramped once per frame
+static SPDIF_IRAM_ATTR const uint8_t *spdif_encode_gain(const uint8_t *p, const uint8_t *end)
+{
+    int ch = ((spdif_ptr - spdif_buf) / 2) & 1;
+    int32_t gain = spdif_gain;
+    int32_t step = spdif_gain_step;
+
+    for (size_t n = spdif_encode_count(p, end); n > 0; n--) {
+	int32_t s = ((int16_t)(*p | (*(p + 1) << 8)) * (gain >> SPDIF_GAIN_FRAC)) >> 15;
+
+	*(spdif_ptr + 1) = (uint32_t)(((bmc_tab[s & 0xff] << 16) ^ bmc_tab[(s >> 8) & 0xff]) << 1) >> 1;
+	SPDIF_TAP(s);
+
+#ifdef CONFIG_SPDIF_LEVEL_METER
+	spdif_meter_sample(ch, s);
+#endif
+	if (ch && step) {
+	    gain = spdif_gain_ramp(gain, step, 1);
+	    step = spdif_gain_step;
+	}
+	ch ^= 1;
+
+	p += 2;
+	spdif_ptr += 2;
+    }
+    spdif_gain = gain;
+    return p;
+}
+
+// encode one 16bit non-audio data, the parity is sent in P bit
+static inline void spdif_encode_nonaudio_word(uint32_t bmc)
+{
+    int parity = bmc >> 31;	// first half bit is set for odd parity
+    int cs = 0;
+
+    if ((spdif_ptr - spdif_buf) / 4 == CS_NONAUDIO_FRAME &&
+	((uint8_t *)spdif_buf)[SYNC_OFFSET] == SYNC_M) {
+	cs = 1;			// first half of the block
+    }
+
+    ((uint8_t *)spdif_ptr)[VUCP_OFFSET] = spdif_vucp;
+    *(spdif_ptr + 1) = parity ? ~bmc : bmc;
+    spdif_vucp = bmc_vucp_tab[parity][cs];
+    spdif_ptr += 2;
+}
+
+// encode non-audio data, every data bit is kept as is
+static SPDIF_IRAM_ATTR const uint8_t *spdif_encode_nonaudio(const uint8_t *p, const uint8_t *end)
+{
+    for (size_t n = spdif_encode_count(p, end); n > 0; n--) {
+	SPDIF_TAP(*p | (*(p + 1) << 8));
+	spdif_encode_nonaudio_word((uint32_t)((bmc_tab[*p] << 16) ^ bmc_tab[*(p + 1)]));
+	p += 2;
+    }
+    return p;
+}
+
+// write audio data to S/PDIF buffer
+void SPDIF_IRAM_ATTR spdif_write(const void *src, size_t size)
+{
+    const uint8_t *p = src;
+    const uint8_t *end = p + size;
+
+    if (spdif_gain_update) {
+	spdif_gain_apply();
+    }
+
+    // A byte ring buffer may split 16bit data at its end. Only whole data
+    // are encoded, an odd byte is kept for the next write.
+    if (spdif_carried && p < end) {
+	spdif_carry[1] = *p++;
+	spdif_carried = false;
+	spdif_write(spdif_carry, sizeof(spdif_carry));
+    }
+    if ((end - p) & 1) {
+	spdif_carry[0] = *--end;
+	spdif_carried = true;
+    }
+
+    while (p < end) {
+
+#ifdef CONFIG_SPDIF_SILENCE_CACHE
+	// send pre-encoded silence instead of encoding zero data or muted audio
+	if (spdif_ptr == spdif_buf && !spdif_nonaudio && end - p >= SPDIF_PCM_BUF_SIZE &&
+	    ((spdif_gain == 0 && spdif_gain_step == 0) || spdif_is_silent(p, SPDIF_PCM_BUF_SIZE))) {
+	    if (spdif_gain_step) {
+		spdif_gain = spdif_gain_ramp(spdif_gain, spdif_gain_step, SPDIF_PCM_BUF_SIZE / 4);
+	    }
+	    spdif_flush(spdif_silence_buf);
+	    p += SPDIF_PCM_BUF_SIZE;
+	    continue;
+	}
+#endif
+
+	if (spdif_nonaudio) {
+	    p = spdif_encode_nonaudio(p, end);
+	} else if (spdif_gain == SPDIF_GAIN_FULL && spdif_gain_step == 0) {
+	    p = spdif_encode(p, end);
+	} else {
+	    p = spdif_encode_gain(p, end);
+	}
+
+	if (spdif_ptr >= &spdif_buf[SPDIF_BUF_ARRAY_SIZE]) {
+	    spdif_flush(spdif_buf);
+	}
+    }
+}
+
+// fill up S/PDIF buffer with silence and send it
+void SPDIF_IRAM_ATTR spdif_write_silence(void)
+{
+    if (spdif_gain_update) {
+	spdif_gain_apply();
+    }
+    spdif_gain_skip();
+
+#ifdef CONFIG_SPDIF_SILENCE_CACHE
+    if (spdif_ptr == spdif_buf && !spdif_nonaudio) {
+	spdif_flush(spdif_silence_buf);
+	return;
+    }
+#endif
+    while (spdif_ptr < &spdif_buf[SPDIF_BUF_ARRAY_SIZE]) {
+	SPDIF_TAP(0);
+	if (spdif_nonaudio) {
+	    spdif_encode_nonaudio_word(BMC_ZERO);
+	} else {
+	    *(spdif_ptr + 1) = BMC_ZERO;
+	    spdif_ptr += 2;
+	}
+    }
+    spdif_flush(spdif_buf);
+}
+
+// select audio (linear PCM) or non-audio (IEC 61937) transmission
+void spdif_set_nonaudio(bool nonaudio)
+{
+    spdif_nonaudio_req = nonaudio;
+}
+
+// get audio levels of the last buffer
+bool spdif_get_levels(spdif_levels_t *levels)
+{
+#ifdef CONFIG_SPDIF_LEVEL_METER
+    spdif_meter_t m;
+    uint32_t seq;
+
+    do {
+	seq = spdif_meter_seq;
+	__sync_synchronize();
+	m = spdif_meter_pub;
+	__sync_synchronize();
+    } while ((seq & 1) || seq != spdif_meter_seq);
+
+    levels->blocks = seq / 2;
+    for (int ch = 0; ch < 2; ch++) {
+	levels->peak[ch] = m.peak[ch];
+	levels->rms[ch] = sqrtf((float)m.sumsq[ch] / (SPDIF_BUF_ARRAY_SIZE / 4));
+	levels->clips[ch] = m.clips[ch];
+    }
+    return true;
+#else
+    memset(levels, 0, sizeof(*levels));
+    return false;
+#endif
+}
+// request target gain of volume and mute
+static void spdif_gain_request(void)
+{
+    spdif_gain_req = spdif_muted ? 0 : spdif_volume;
+    __sync_synchronize();
+    spdif_gain_update = true;
+}
+
+// set volume
+void spdif_set_gain(int gain)
+{
+    spdif_volume = (gain < 0) ? 0 : (gain > SPDIF_GAIN_UNITY) ? SPDIF_GAIN_UNITY : gain;
+    spdif_gain_request();
+}
+
+// fade out or in
+void spdif_enc_set_mute(bool mute)
+{
+    spdif_muted = mute;
+    spdif_gain_request();
+}
+
+// mute state
+bool spdif_enc_muted(void)
+{
+    return spdif_muted;
+}
+
+// gain change not finished by the encoder
+bool spdif_enc_ramping(void)
+{
+    return spdif_gain_update || spdif_gain_step != 0;
+}
+
+// frames encoded but not output yet
+size_t SPDIF_IRAM_ATTR spdif_enc_pending(void)
+{
+    return (spdif_ptr - spdif_buf) / 4;
+}
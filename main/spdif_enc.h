@@ -0,0 +1,77 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __SPDIF_ENC_H__
+#define __SPDIF_ENC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Interface between the S/PDIF encoder (spdif_enc.c) and its output,
+ * the I2S driver (spdif.c) or a file (tools/spdif_tool.c). The encoder
+ * itself is used by spdif_write() etc. declared in spdif.h.
+ */
+
+#define SPDIF_BLOCK_SAMPLES	192	// frames per S/PDIF block
+#define SPDIF_BUF_DIV		2	// double buffering
+#define SPDIF_BUF_SIZE		(SPDIF_BLOCK_SAMPLES * 2 * 2 * sizeof(uint32_t) / SPDIF_BUF_DIV)
+
+/*
+ * audio hot path in IRAM and DRAM, free of flash cache misses
+ */
+#if defined(ESP_PLATFORM) && defined(CONFIG_SPDIF_IRAM)
+#include "esp_attr.h"
+#define SPDIF_IRAM_ATTR		IRAM_ATTR
+#define SPDIF_DRAM_ATTR		DRAM_ATTR
+#else
+#define SPDIF_IRAM_ATTR
+#define SPDIF_DRAM_ATTR
+#endif
+
+#ifdef CONFIG_SPDIF_GAIN_RAMP_MS
+#define SPDIF_GAIN_RAMP_MS	CONFIG_SPDIF_GAIN_RAMP_MS
+#else
+#define SPDIF_GAIN_RAMP_MS	20
+#endif
+
+/*
+ * output function
+ *   buf: I2S words, 2 words per 16bit sample, MSb is sent first
+ *   size: number of bytes, always SPDIF_BUF_SIZE
+ */
+typedef void (*spdif_enc_output_t)(const uint32_t *buf, size_t size);
+
+/*
+ * initialize encoder, the buffer starts at an S/PDIF block
+ *   rate: sampling rate, used for the gain ramp time
+ *   output: called for each encoded buffer
+ */
+void spdif_enc_init(int rate, spdif_enc_output_t output);
+
+/*
+ * request fade out or in, run by the next spdif_write()
+ */
+void spdif_enc_set_mute(bool mute);
+
+/*
+ * current mute request
+ */
+bool spdif_enc_muted(void);
+
+/*
+ * true until a requested gain is reached
+ */
+bool spdif_enc_ramping(void);
+
+/*
+ * frames in the current buffer, sent with the next full buffer
+ */
+size_t spdif_enc_pending(void);
+
+#endif /* __SPDIF_ENC_H__ */
@@ -0,0 +1,96 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2s.h"
+#include "esp_log.h"
+#include "spdif_rx.h"
+
+#ifdef CONFIG_SPDIF_RX_PIN
+#define SPDIF_RX_PIN		CONFIG_SPDIF_RX_PIN
+#else
+#define SPDIF_RX_PIN		26
+#endif
+
+#define SPDIF_RX_TAG		"SPDIF_RX"
+#define I2S_RX_NUM		(1)	// I2S0 is the transmitter
+
+/*
+ * The input is sampled as 32bit stereo I2S data, so the sampling clock
+ * is the bit clock, 64 samples per I2S frame. 20MHz is 160MHz PLL / 8
+ * (the APLL is used by the transmitter), 3.26 samples per half bit at
+ * 48kHz.
+ */
+#define RX_CLOCK		(20 * 1000 * 1000)
+#define RX_I2S_RATE		(RX_CLOCK / 64)
+#define RX_DMA_BUF_COUNT	4
+#define RX_DMA_BUF_LEN		256	// I2S frames, 2 words each
+#define RX_READ_WORDS		(RX_DMA_BUF_LEN * 2)
+#define RX_TASK_STACK		2048
+
+static uint32_t rx_buf[RX_READ_WORDS];
+
+// read and decode the sampled input, log lock changes
+static void spdif_rx_task_handler(void *arg)
+{
+    spdif_dec_status_t status;
+    bool locked = false;
+    size_t len;
+
+    for (;;) {
+	i2s_read(I2S_RX_NUM, rx_buf, sizeof(rx_buf), &len, portMAX_DELAY);
+	spdif_dec_process(rx_buf, len / sizeof(uint32_t));
+
+	spdif_dec_get_status(&status);
+	if (status.locked != locked) {
+	    locked = status.locked;
+	    if (locked) {
+		ESP_LOGI(SPDIF_RX_TAG, "input locked, %dHz (measured %uHz)%s",
+			 status.rate, status.measured_rate, status.nonaudio ? ", non-audio" : "");
+	    } else {
+		ESP_LOGI(SPDIF_RX_TAG, "input lost, %u errors", status.errors);
+	    }
+	}
+    }
+}
+
+// start S/PDIF receiver
+esp_err_t spdif_rx_init(spdif_dec_output_t output)
+{
+    i2s_config_t i2s_config = {
+	.mode = I2S_MODE_MASTER | I2S_MODE_RX,
+	.sample_rate = RX_I2S_RATE,
+	.bits_per_sample = 32,
+	.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+	.communication_format = I2S_COMM_FORMAT_I2S_MSB,
+	.intr_alloc_flags = 0,
+	.dma_buf_count = RX_DMA_BUF_COUNT,
+	.dma_buf_len = RX_DMA_BUF_LEN,
+	.use_apll = false,
+    };
+    i2s_pin_config_t pin_config = {
+	.bck_io_num = -1,
+	.ws_io_num = -1,
+	.data_out_num = -1,
+	.data_in_num = SPDIF_RX_PIN,
+    };
+
+    if (output == NULL) {
+	// decoding for nothing but the status costs a core
+	ESP_LOGE(SPDIF_RX_TAG, "no output for the decoded audio");
+	return ESP_ERR_INVALID_ARG;
+    }
+    ESP_ERROR_CHECK(i2s_driver_install(I2S_RX_NUM, &i2s_config, 0, NULL));
+    ESP_ERROR_CHECK(i2s_set_pin(I2S_RX_NUM, &pin_config));
+
+    spdif_dec_init(RX_CLOCK, output);
+    xTaskCreatePinnedToCore(spdif_rx_task_handler, "SpdifRxT", RX_TASK_STACK, NULL,
+			    configMAX_PRIORITIES - 3, NULL, 1);
+    return ESP_OK;
+}
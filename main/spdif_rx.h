@@ -0,0 +1,24 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __SPDIF_RX_H__
+#define __SPDIF_RX_H__
+
+#include "esp_err.h"
+#include "spdif_dec.h"
+
+/*
+ * start S/PDIF receiver, not started by the example itself
+ *   the input pin is sampled by I2S1 at 20MHz (up to 48kHz input) and
+ *   decoded by a task on core 1, the status is read by
+ *   spdif_dec_get_status()
+ *   output: called by the task with decoded audio data while locked
+ *   return: ESP_OK, ESP_ERR_INVALID_ARG without output
+ */
+esp_err_t spdif_rx_init(spdif_dec_output_t output);
+
+#endif /* __SPDIF_RX_H__ */
@@ -0,0 +1,487 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdlib.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+#include "spdif_enc.h"
+#include "sync.h"
+
+/*
+ * Synchronized playback. Every node counts the stream position, the
+ * frames taken from its ring buffer since the stream start, and knows
+ * when the next item is played (local time). The master announces its
+ * timeline, the position played at a time of its clock. A slave
+ * measures the master clock by NTP style time requests. The network
+ * delay is the least symmetric for long round trips, so only the
+ * request with the shortest round trip of every SYNC_WINDOW is used, a
+ * line fitted through these over about 13s gives the offset and the
+ * drift.
+ *
+ * Corrections are made when an item is taken from the ring buffer, so
+ * that the ring buffer only holds the received stream and the position
+ * is the same on all nodes. A slave drops or inserts one frame per item
+ * to follow the master within SYNC_DEADBAND frames, larger errors (at
+ * start) are trimmed at once. Without the master's timeline each node
+ * keeps its ring buffer between 3/8 and 5/8 full like write_ringbuf()
+ * does without synchronization, but fills it up to half by silence at
+ * once so that the timeline is not bent by a frame per item for long.
+ * A slave whose A2DP source runs at another rate than the master's
+ * cannot follow and keep its ring buffer: when the mean level drifts
+ * from where it settled by more than an eighth of the ring buffer, as
+ * far as from half to 3/8 or 5/8, the level is kept instead and the
+ * status reports the lost lock.
+ */
+
+#define SYNC_MAGIC		0x434e5953	// "SYNC"
+#define SYNC_VERSION		1
+#define SYNC_BEACON		1
+#define SYNC_REQUEST		2
+#define SYNC_RESPONSE		3
+#define SYNC_PLAYING		0x01		// timeline flag
+
+#define SYNC_WINDOW		8		// time samples per fit point
+#define SYNC_FIT		16		// fit points, about 13s
+#define SYNC_FIT_MIN		3		// fit points for the drift
+#define SYNC_MAX_DRIFT		1e-3		// limit of the fitted drift
+#define SYNC_MAX_RTT_US		(100 * 1000)	// longer round trips are not used
+#define SYNC_JUMP_US		(10 * 1000)	// master clock restarted
+#define SYNC_TIMEOUT_US		(3 * 1000 * 1000)	// master lost
+#define SYNC_STALL_US		(100 * 1000)	// master not playing
+#define SYNC_TRIM_FRAMES	32		// larger errors are corrected at once
+#define SYNC_DEADBAND		1		// error in frames left alone
+#define SYNC_LEVEL_AVG		64		// ring buffer items averaged
+#define SYNC_LEVEL_SETTLE	(4 * SYNC_LEVEL_AVG)	// items until the level is kept
+
+// playback position at a time
+typedef struct {
+    bool playing;
+    int rate;
+    int64_t anchor_us;		// play time of anchor_index
+    int64_t anchor_index;	// stream position
+} sync_timeline_t;
+
+// master clock and timeline, estimated by a slave
+typedef struct {
+    bool valid;
+    int64_t offset_us;		// master clock - local clock at sample_us
+    int64_t sample_us;		// local time of the time sample
+    int32_t drift_ppb;
+    int32_t rtt_us;
+    sync_timeline_t master;	// in master clock
+    int64_t master_us;		// local time the timeline was received
+} sync_clock_t;
+
+typedef struct {
+    int64_t local_us;
+    int64_t offset_us;
+    int32_t rtt_us;
+} sync_sample_t;
+
+static sync_role_t sync_role;
+static uint32_t sync_node;
+static uint32_t sync_seq;
+
+// audio task
+static bool sync_playing;
+static int sync_rate;
+static int64_t sync_index;			// stream position of the next item
+static volatile int32_t sync_error;
+static volatile uint32_t sync_dropped;
+static volatile uint32_t sync_inserted;
+static volatile uint32_t sync_trims;
+static volatile bool sync_level_control;	// slave: following suspended
+static int32_t sync_level;			// mean ring buffer level * SYNC_LEVEL_AVG
+static int64_t sync_level_ref;			// mean level + error when locked
+static int sync_follow_items;
+static int sync_level_items;			// in range while keeping the level
+static volatile uint32_t sync_level_breaks;
+static bool sync_level_fill;			// filling up to half the ring buffer
+
+// own timeline, written by the audio task
+static sync_timeline_t sync_local;
+static volatile uint32_t sync_local_seq;	// odd while publishing
+
+// network task
+static sync_sample_t sync_window_best;
+static int sync_window_count;
+static sync_sample_t sync_fit[SYNC_FIT];
+static int sync_fit_count;
+static int sync_fit_next;
+static sync_clock_t sync_clock;
+
+// master clock, written by the network task
+static sync_clock_t sync_clock_pub;
+static volatile uint32_t sync_clock_seq;	// odd while publishing
+
+// a reader retries while seq is odd or changed
+static void SPDIF_IRAM_ATTR sync_publish(volatile uint32_t *seq, void *dst, const void *src, size_t size)
+{
+    (*seq)++;
+    __sync_synchronize();
+    memcpy(dst, src, size);
+    __sync_synchronize();
+    (*seq)++;
+}
+
+static void SPDIF_IRAM_ATTR sync_read(volatile uint32_t *seq, void *dst, const void *src, size_t size)
+{
+    uint32_t s;
+
+    do {
+	s = *seq;
+	__sync_synchronize();
+	memcpy(dst, src, size);
+	__sync_synchronize();
+    } while ((s & 1) || s != *seq);
+}
+
+// frames played in a time, rounded
+static int64_t SPDIF_IRAM_ATTR sync_us_to_frames(int64_t us, int rate)
+{
+    int64_t n = us * rate;
+
+    return n >= 0 ? (n + 500000) / 1000000 : -((-n + 500000) / 1000000);
+}
+
+// master clock - local clock at a local time
+static int64_t SPDIF_IRAM_ATTR sync_offset(const sync_clock_t *clk, int64_t local_us)
+{
+    return clk->offset_us + (local_us - clk->sample_us) * clk->drift_ppb / 1000000000;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put64(uint8_t *p, int64_t v)
+{
+    put32(p, (uint64_t)v);
+    put32(p + 4, (uint64_t)v >> 32);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int64_t get64(const uint8_t *p)
+{
+    return (int64_t)(get32(p) | (uint64_t)get32(p + 4) << 32);
+}
+
+/*
+ * packet, little endian
+ *    0 magic, version, type
+ *    8 node, sequence number
+ *   16 t1: request sent (slave clock)
+ *   24 t2: request received (master clock)
+ *   32 t3: response or beacon sent (master clock)
+ *   40 timeline: play time (master clock), position, rate, flags
+ */
+static void sync_make_header(uint8_t *p, int type)
+{
+    memset(p, 0, SYNC_PACKET_SIZE);
+    put32(p, SYNC_MAGIC);
+    p[4] = SYNC_VERSION;
+    p[5] = type;
+    put32(p + 8, sync_node);
+    put32(p + 12, sync_seq++);
+}
+
+// master: own timeline
+static void sync_put_timeline(uint8_t *p, int64_t now_us)
+{
+    sync_timeline_t tl;
+
+    sync_read(&sync_local_seq, &tl, &sync_local, sizeof(tl));
+    // the audio task stopped taking items, e.g. the ring buffer ran empty
+    if (tl.playing && now_us - tl.anchor_us > SYNC_STALL_US) {
+	tl.playing = false;
+    }
+    put64(p + 40, tl.anchor_us);
+    put64(p + 48, tl.anchor_index);
+    put32(p + 56, tl.rate);
+    put32(p + 60, tl.playing ? SYNC_PLAYING : 0);
+}
+
+// slave: master's timeline
+static void sync_get_timeline(const uint8_t *p, int64_t now_us)
+{
+    sync_clock.master.anchor_us = get64(p + 40);
+    sync_clock.master.anchor_index = get64(p + 48);
+    sync_clock.master.rate = get32(p + 56);
+    sync_clock.master.playing = get32(p + 60) & SYNC_PLAYING;
+    sync_clock.master_us = now_us;
+}
+
+// slave: least squares line through the fit points, at the newest one
+static void sync_fit_line(void)
+{
+    const sync_sample_t *last = &sync_fit[(sync_fit_next + SYNC_FIT - 1) % SYNC_FIT];
+    double n = sync_fit_count, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    double slope = 0, offset;
+
+    for (int i = 0; i < sync_fit_count; i++) {
+	double x = sync_fit[i].local_us - last->local_us;
+	double y = sync_fit[i].offset_us - last->offset_us;
+
+	sx += x;
+	sy += y;
+	sxx += x * x;
+	sxy += x * y;
+    }
+    if (sync_fit_count >= SYNC_FIT_MIN) {
+	slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+	slope = slope > SYNC_MAX_DRIFT ? SYNC_MAX_DRIFT : slope < -SYNC_MAX_DRIFT ? -SYNC_MAX_DRIFT : slope;
+    }
+    offset = (sy - slope * sx) / n;
+
+    sync_clock.offset_us = last->offset_us + (int64_t)(offset < 0 ? offset - 0.5 : offset + 0.5);
+    sync_clock.sample_us = last->local_us;
+    sync_clock.drift_ppb = slope * 1e9;
+    sync_clock.rtt_us = last->rtt_us;
+    sync_clock.valid = true;
+}
+
+// slave: add a time sample, the shortest round trip per window is fitted
+static void sync_add_sample(int64_t local_us, int64_t offset_us, int32_t rtt_us)
+{
+    if (sync_window_count == 0 || rtt_us < sync_window_best.rtt_us) {
+	sync_window_best.local_us = local_us;
+	sync_window_best.offset_us = offset_us;
+	sync_window_best.rtt_us = rtt_us;
+    }
+    if (++sync_window_count < SYNC_WINDOW) {
+	return;
+    }
+    sync_window_count = 0;
+
+    // start over when the master clock jumped, e.g. after a restart
+    if (sync_clock.valid &&
+	llabs(sync_window_best.offset_us - sync_offset(&sync_clock, sync_window_best.local_us)) > SYNC_JUMP_US) {
+	sync_fit_count = 0;
+    }
+    sync_fit[sync_fit_next] = sync_window_best;
+    sync_fit_next = (sync_fit_next + 1) % SYNC_FIT;
+    if (sync_fit_count < SYNC_FIT) {
+	sync_fit_count++;
+    }
+    sync_fit_line();
+}
+
+// initialize
+void sync_init(sync_role_t role, uint32_t node)
+{
+    sync_role = role;
+    sync_node = node;
+    sync_window_count = sync_fit_count = sync_fit_next = 0;
+    memset(&sync_clock, 0, sizeof(sync_clock));
+    sync_publish(&sync_clock_seq, &sync_clock_pub, &sync_clock, sizeof(sync_clock));
+}
+
+// stream start
+void sync_start(int rate)
+{
+    sync_rate = rate;
+    sync_index = 0;
+    sync_follow_items = 0;
+    sync_level_control = false;
+    sync_level_fill = false;
+    sync_playing = true;
+}
+
+// stream stop
+void sync_stop(void)
+{
+    sync_timeline_t tl = { 0 };
+
+    sync_playing = false;
+    sync_publish(&sync_local_seq, &sync_local, &tl, sizeof(tl));
+}
+
+// correction for the next ring buffer item
+int SPDIF_IRAM_ATTR sync_playout(int64_t playout_us, size_t frames, size_t ring_frames, size_t ring_size)
+{
+    sync_clock_t clk;
+    bool follow = false;
+    int64_t e = 0;
+    int c = 0;
+
+    if (!sync_playing) {
+	return 0;
+    }
+    // items and A2DP packets make the level jump, keep a mean
+    if (sync_index == 0) {
+	sync_level = ring_frames * SYNC_LEVEL_AVG;
+    }
+    sync_level += ((int32_t)ring_frames * SYNC_LEVEL_AVG - sync_level) / SYNC_LEVEL_AVG;
+
+    if (sync_role == SYNC_SLAVE) {
+	sync_read(&sync_clock_seq, &clk, &sync_clock_pub, sizeof(clk));
+	follow = clk.valid && clk.master.playing && clk.master.rate == sync_rate &&
+	    playout_us - clk.master_us < SYNC_TIMEOUT_US;
+    }
+    if (follow) {
+	// position the master plays at the same time
+	int64_t master_us = playout_us + sync_offset(&clk, playout_us);
+	int64_t level, window;
+
+	e = sync_index - clk.master.anchor_index -
+	    sync_us_to_frames(master_us - clk.master.anchor_us, sync_rate);
+	sync_error = e;
+
+	// Following moves the level to the mean plus the error, which
+	// stays where it settled unless the A2DP source drifts against the
+	// master's. When it is off by more than an eighth of the ring
+	// buffer, the level is kept instead. The kept 3/8 to 5/8 band
+	// reaches past that eighth, so following resumes only when the
+	// level is back within a 32nd.
+	window = (int64_t)ring_size / (sync_level_control ? 32 : 8);
+	level = sync_level / SYNC_LEVEL_AVG + e;
+	if (sync_follow_items < SYNC_LEVEL_SETTLE) {
+	    sync_level_ref = level;
+	    sync_follow_items++;
+	} else if (level < sync_level_ref - window || level > sync_level_ref + window) {
+	    if (!sync_level_control) {
+		sync_level_breaks++;
+	    }
+	    sync_level_control = true;
+	    sync_level_items = 0;
+	} else if (sync_level_control && ++sync_level_items >= SYNC_LEVEL_SETTLE) {
+	    // back in range after the mean caught up with the corrections
+	    sync_level_control = false;
+	}
+	follow = !sync_level_control;
+    } else {
+	sync_follow_items = 0;
+	sync_level_control = false;
+    }
+
+    if (follow) {
+	if (e > SYNC_TRIM_FRAMES || e < -SYNC_TRIM_FRAMES) {
+	    c = e > SYNC_MAX_INSERT ? -SYNC_MAX_INSERT : e < -(int64_t)frames ? (int)frames : -e;
+	} else if (e > SYNC_DEADBAND) {
+	    c = -1;			// ahead, wait
+	} else if (e < -SYNC_DEADBAND) {
+	    c = 1;			// behind, skip
+	}
+    } else if (sync_level / SYNC_LEVEL_AVG > ring_size * 5 / 8) {
+	c = 1;
+    } else if (sync_level / SYNC_LEVEL_AVG < ring_size * (sync_level_fill ? 4 : 3) / 8) {
+	// fill up at start or after an underrun, the timeline stays smooth
+	c = -(int)(ring_size / 2 - sync_level / SYNC_LEVEL_AVG);
+	c = c < -SYNC_MAX_INSERT ? -SYNC_MAX_INSERT : c;
+	sync_level_fill = true;
+    } else {
+	sync_level_fill = false;
+    }
+    // the correction moves the level at once, the mean must not repeat it
+    sync_level -= c * SYNC_LEVEL_AVG;
+
+    if (c > 0) {
+	sync_dropped += c;
+    } else {
+	sync_inserted -= c;
+    }
+    if (c > 1 || c < -1) {
+	sync_trims++;
+    }
+
+    if (sync_role == SYNC_MASTER) {
+	// position sync_index + c is played at playout_us
+	sync_timeline_t tl = {
+	    .playing = true,
+	    .rate = sync_rate,
+	    .anchor_us = playout_us,
+	    .anchor_index = sync_index + c,
+	};
+
+	sync_publish(&sync_local_seq, &sync_local, &tl, sizeof(tl));
+    }
+    sync_index += frames;
+    return c;
+}
+
+// periodic packet
+size_t sync_make_packet(uint8_t *buf, int64_t now_us)
+{
+    if (sync_role == SYNC_MASTER) {
+	sync_make_header(buf, SYNC_BEACON);
+	put64(buf + 32, now_us);
+	sync_put_timeline(buf, now_us);
+    } else {
+	sync_make_header(buf, SYNC_REQUEST);
+	put64(buf + 16, now_us);
+    }
+    return SYNC_PACKET_SIZE;
+}
+
+// received packet
+int sync_receive(const uint8_t *buf, size_t len, int64_t now_us, uint8_t *reply)
+{
+    int type;
+
+    if (len < SYNC_PACKET_SIZE || get32(buf) != SYNC_MAGIC || buf[4] != SYNC_VERSION ||
+	get32(buf + 8) == sync_node) {
+	return -1;
+    }
+    type = buf[5];
+
+    if (sync_role == SYNC_MASTER) {
+	if (type != SYNC_REQUEST) {
+	    return -1;
+	}
+	sync_make_header(reply, SYNC_RESPONSE);
+	memcpy(reply + 16, buf + 16, 8);	// t1
+	put64(reply + 24, now_us);		// t2
+	put64(reply + 32, now_us);		// t3, sent right away
+	sync_put_timeline(reply, now_us);
+	return SYNC_PACKET_SIZE;
+    }
+
+    if (type == SYNC_RESPONSE) {
+	int64_t t1 = get64(buf + 16);
+	int64_t t2 = get64(buf + 24);
+	int64_t t3 = get64(buf + 32);
+	int64_t rtt = (now_us - t1) - (t3 - t2);
+
+	if (rtt >= 0 && rtt <= SYNC_MAX_RTT_US) {
+	    sync_add_sample(now_us, ((t2 - t1) + (t3 - now_us)) / 2, rtt);
+	}
+    } else if (type != SYNC_BEACON) {
+	return -1;
+    }
+    sync_get_timeline(buf, now_us);
+    sync_publish(&sync_clock_seq, &sync_clock_pub, &sync_clock, sizeof(sync_clock));
+    return 0;
+}
+
+// get status
+void sync_get_status(sync_status_t *status)
+{
+    sync_clock_t clk;
+
+    sync_read(&sync_clock_seq, &clk, &sync_clock_pub, sizeof(clk));
+    status->role = sync_role;
+    status->level_control = sync_role == SYNC_SLAVE && sync_level_control;
+    status->locked = sync_role == SYNC_SLAVE && clk.valid && clk.master.playing && !status->level_control;
+    status->offset_us = clk.offset_us;
+    status->rtt_us = clk.rtt_us;
+    status->drift_ppb = clk.drift_ppb;
+    status->error_frames = sync_error;
+    status->dropped = sync_dropped;
+    status->inserted = sync_inserted;
+    status->trims = sync_trims;
+    status->level_breaks = sync_level_breaks;
+}
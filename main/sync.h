@@ -0,0 +1,101 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __SYNC_H__
+#define __SYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Synchronized playback of several sinks, independent of the platform.
+ * The network glue (sync_net.c or tools/sync_sim.c) passes packets and
+ * local clock times in microseconds, the audio task asks for a
+ * correction per ring buffer item.
+ */
+
+#define SYNC_PACKET_SIZE	64	// bytes, all packet types
+#define SYNC_POLL_MS		100	// slave time request period
+#define SYNC_BEACON_MS		500	// master announcement period
+#define SYNC_MAX_INSERT		96	// frames inserted per item at most
+
+typedef enum {
+    SYNC_MASTER = 0,		// plays freely, announces its timeline
+    SYNC_SLAVE,			// follows the master's timeline
+} sync_role_t;
+
+typedef struct {
+    sync_role_t role;
+    bool locked;		// slave: follows the master clock and timeline
+    bool level_control;		// slave: ring buffer level drifted by an
+				// eighth, it is kept instead of following
+    int64_t offset_us;		// master clock - local clock
+    int32_t rtt_us;		// round trip time of the used time sample
+    int32_t drift_ppb;		// master clock rate - local clock rate
+    int32_t error_frames;	// slave: playout error before the last correction
+    uint32_t dropped;		// frames dropped from the ring buffer
+    uint32_t inserted;		// frames inserted
+    uint32_t trims;		// corrections of more than one frame
+    uint32_t level_breaks;	// slave: times following gave way to level control
+} sync_status_t;
+
+/*
+ * initialize
+ *   role: SYNC_MASTER or SYNC_SLAVE
+ *   node: node id, unique in the network
+ */
+void sync_init(sync_role_t role, uint32_t node);
+
+/*
+ * stream start and stop, called by the audio task
+ *   rate: sampling rate of the stream
+ *   the stream position starts at 0 and counts this node's frames, the
+ *   nodes are aligned by this count, not by the audio content: nodes
+ *   whose streams did not start with the same audio data keep that
+ *   offset
+ */
+void sync_start(int rate);
+void sync_stop(void);
+
+/*
+ * get the correction for the next ring buffer item, called by the
+ * audio task
+ *   playout_us: local time when the first frame of the item is played
+ *   frames: stereo frames in the item
+ *   ring_frames: frames in the ring buffer including the item
+ *   ring_size: ring buffer size in frames
+ *   return: >0: drop this many frames from the start of the item
+ *           <0: insert this many frames before the item
+ *   the stream position advances by frames in any case
+ */
+int sync_playout(int64_t playout_us, size_t frames, size_t ring_frames, size_t ring_size);
+
+/*
+ * make the periodic packet, a beacon (master, to all nodes) or a time
+ * request (slave, to the master)
+ *   buf: SYNC_PACKET_SIZE bytes
+ *   now_us: local time
+ *   return: packet size
+ */
+size_t sync_make_packet(uint8_t *buf, int64_t now_us);
+
+/*
+ * pass a received packet
+ *   now_us: local time of reception
+ *   reply: SYNC_PACKET_SIZE bytes, the response to a time request
+ *   return: size of the reply to send to the sender, 0 for none,
+ *           -1 when the packet is not for this node
+ */
+int sync_receive(const uint8_t *buf, size_t len, int64_t now_us, uint8_t *reply);
+
+/*
+ * get status
+ */
+void sync_get_status(sync_status_t *status);
+
+#endif /* __SYNC_H__ */
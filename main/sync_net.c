@@ -0,0 +1,180 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "tcpip_adapter.h"
+#include "lwip/sockets.h"
+#include "sync.h"
+#include "sync_net.h"
+
+/*
+ * Network glue of the synchronized playback (sync.c). All nodes join
+ * the same WiFi network as stations and use one UDP port. The master
+ * broadcasts its timeline, a slave learns the master's address from it
+ * and polls the master clock. Packets are timestamped right at
+ * recvfrom() and sendto(), a late timestamp makes a long round trip
+ * that sync.c does not use.
+ */
+
+#ifdef CONFIG_SPDIF_SYNC_PORT
+#define SYNC_PORT		CONFIG_SPDIF_SYNC_PORT
+#define SYNC_SSID		CONFIG_SPDIF_SYNC_SSID
+#define SYNC_PASSWORD		CONFIG_SPDIF_SYNC_PASSWORD
+#else
+#define SYNC_PORT		5550
+#define SYNC_SSID		""
+#define SYNC_PASSWORD		""
+#endif
+
+#define SYNC_TAG		"SYNC"
+#define SYNC_TASK_STACK		3072
+#define SYNC_RECV_TIMEOUT_MS	10	// period check while no packet arrives
+#define SYNC_REPORT_MS		10000	// status log period
+#define SYNC_CONNECTED_BIT	BIT0
+
+#ifdef CONFIG_SPDIF_SYNC_MASTER
+#define SYNC_ROLE		SYNC_MASTER
+#define SYNC_PERIOD_MS		SYNC_BEACON_MS
+#else
+#define SYNC_ROLE		SYNC_SLAVE
+#define SYNC_PERIOD_MS		SYNC_POLL_MS
+#endif
+
+static EventGroupHandle_t sync_events;
+
+// keep connected to the access point
+static void sync_wifi_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && (id == WIFI_EVENT_STA_START || id == WIFI_EVENT_STA_DISCONNECTED)) {
+	xEventGroupClearBits(sync_events, SYNC_CONNECTED_BIT);
+	esp_wifi_connect();
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+	ip_event_got_ip_t *event = (ip_event_got_ip_t *)data;
+
+	ESP_LOGI(SYNC_TAG, "connected, %s", ip4addr_ntoa(&event->ip_info.ip));
+	xEventGroupSetBits(sync_events, SYNC_CONNECTED_BIT);
+    }
+}
+
+// log lock changes and the status
+static void sync_report(bool *locked, TickType_t *last)
+{
+    sync_status_t status;
+
+    sync_get_status(&status);
+    if (status.locked == *locked && xTaskGetTickCount() - *last < pdMS_TO_TICKS(SYNC_REPORT_MS)) {
+	return;
+    }
+    if (status.role == SYNC_SLAVE && status.locked != *locked) {
+	ESP_LOGI(SYNC_TAG, "%s", status.locked ? "locked to master" :
+		 status.level_control ? "ring buffer out of range, keeping the level" : "master lost");
+    }
+    ESP_LOGI(SYNC_TAG, "offset %lldus, rtt %dus, drift %dppb, error %d frames, "
+	     "dropped %u, inserted %u, trims %u, level breaks %u",
+	     status.offset_us, status.rtt_us, status.drift_ppb, status.error_frames,
+	     status.dropped, status.inserted, status.trims, status.level_breaks);
+    *locked = status.locked;
+    *last = xTaskGetTickCount();
+}
+
+// send the periodic packet, answer requests, pass the master's packets
+static void sync_task_handler(void *arg)
+{
+    struct sockaddr_in addr = {
+	.sin_family = AF_INET,
+	.sin_port = htons(SYNC_PORT),
+	.sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct sockaddr_in master = { 0 };
+    struct sockaddr_in from;
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = SYNC_RECV_TIMEOUT_MS * 1000 };
+    socklen_t from_len;
+    uint8_t buf[SYNC_PACKET_SIZE];
+    uint8_t reply[SYNC_PACKET_SIZE];
+    TickType_t next, last_report;
+    bool locked = false;
+    int sock, on = 1;
+
+    xEventGroupWaitBits(sync_events, SYNC_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	ESP_LOGE(SYNC_TAG, "no socket on port %d", SYNC_PORT);
+	vTaskDelete(NULL);
+    }
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    next = last_report = xTaskGetTickCount();
+
+    for (;;) {
+	int len;
+
+	from_len = sizeof(from);
+	len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+	if (len > 0) {
+	    int n = sync_receive(buf, len, esp_timer_get_time(), reply);
+
+	    if (n > 0) {
+		sendto(sock, reply, n, 0, (struct sockaddr *)&from, from_len);
+	    } else if (n == 0) {
+		master = from;		// slave: beacon or response of the master
+	    }
+	}
+
+	if ((int32_t)(xTaskGetTickCount() - next) < 0) {
+	    continue;
+	}
+	next += pdMS_TO_TICKS(SYNC_PERIOD_MS);
+	if (SYNC_ROLE == SYNC_MASTER) {
+	    len = sync_make_packet(buf, esp_timer_get_time());
+	    sendto(sock, buf, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+	} else if (master.sin_family == AF_INET) {
+	    len = sync_make_packet(buf, esp_timer_get_time());
+	    sendto(sock, buf, len, 0, (struct sockaddr *)&master, sizeof(master));
+	}
+	sync_report(&locked, &last_report);
+    }
+}
+
+// connect to WiFi, start the sync task
+void sync_net_init(void)
+{
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    wifi_config_t wifi_config = {
+	.sta = {
+	    .ssid = SYNC_SSID,
+	    .password = SYNC_PASSWORD,
+	},
+    };
+    uint8_t mac[6];
+
+    sync_events = xEventGroupCreate();
+    tcpip_adapter_init();
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, sync_wifi_event, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, sync_wifi_event, NULL));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+    // the node id tells own broadcasts apart
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    sync_init(SYNC_ROLE, (uint32_t)mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5]);
+    ESP_LOGI(SYNC_TAG, "%s on port %d", SYNC_ROLE == SYNC_MASTER ? "master" : "slave", SYNC_PORT);
+
+    xTaskCreate(sync_task_handler, "SyncT", SYNC_TASK_STACK, NULL, configMAX_PRIORITIES - 4, NULL);
+}
@@ -0,0 +1,20 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __SYNC_NET_H__
+#define __SYNC_NET_H__
+
+/*
+ * start synchronized playback over WiFi
+ *   connects to the configured access point as a station, then the
+ *   master sends beacons to the broadcast address and answers time
+ *   requests, a slave sends time requests to the master
+ *   NVS must be initialized
+ */
+void sync_net_init(void);
+
+#endif /* __SYNC_NET_H__ */
@@ -0,0 +1,190 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <math.h>
+#include "upsample.h"
+
+#ifdef ESP_PLATFORM
+#include "sys/lock.h"
+#else
+typedef int _lock_t;
+#define _lock_acquire(l)	((void)(l))
+#define _lock_release(l)	((void)(l))
+#endif
+
+/*
+ * Fixed ratio polyphase interpolator. The input is upsampled by
+ * UPSAMPLE_L, low-pass filtered and decimated by 1 (16kHz) or 2 (32kHz),
+ * only the needed phase is computed for each output sample. Both
+ * ratios have the same filter relative to the upsampled rate, so one
+ * coefficient set of UPSAMPLE_L phases serves both. Per output frame
+ * this is UPSAMPLE_TAPS multiplies per input channel, a mono stream is
+ * filtered once and written to both channels.
+ */
+#define UPSAMPLE_OUT_RATE	48000
+#define UPSAMPLE_L		3	// 16kHz * 3, 32kHz * 3 / 2
+#define UPSAMPLE_TAPS		24	// filter length in input samples
+#define UPSAMPLE_COEF_BITS	15	// Q15 coefficients
+#define UPSAMPLE_CUTOFF		0.85f	// relative to the input Nyquist frequency
+#define UPSAMPLE_KAISER_BETA	6.0f	// Kaiser window, about 60dB stopband
+
+static int16_t upsample_coef[UPSAMPLE_L][UPSAMPLE_TAPS];
+static int16_t upsample_hist[2][UPSAMPLE_TAPS * 2];	// doubled for contiguous window
+static bool upsample_coef_done;
+static int upsample_hist_pos;
+static int upsample_m;			// decimation, 0 when not converting
+static int upsample_channels = 2;
+static int upsample_phase;		// output position in 1/UPSAMPLE_L input samples
+static _lock_t upsample_lock;
+
+// zeroth order modified Bessel function of the first kind
+static float bessel_i0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+
+    for (int k = 1; k < 32; k++) {
+	term *= (x / (2 * k)) * (x / (2 * k));
+	sum += term;
+	if (term < sum * 1e-7f) {
+	    break;
+	}
+    }
+    return sum;
+}
+
+// windowed sinc at the upsampled rate, split into phases
+static void upsample_make_coef(void)
+{
+    const int n = UPSAMPLE_L * UPSAMPLE_TAPS;
+    const float half = (n - 1) / 2.0f;
+    const float fc = UPSAMPLE_CUTOFF / (2 * UPSAMPLE_L);
+    float i0_beta = bessel_i0(UPSAMPLE_KAISER_BETA);
+
+    for (int p = 0; p < UPSAMPLE_L; p++) {
+	float c[UPSAMPLE_TAPS];
+	float sum = 0;
+
+	// coefficient k is applied to the k-th oldest input sample
+	for (int k = 0; k < UPSAMPLE_TAPS; k++) {
+	    int j = p + UPSAMPLE_L * (UPSAMPLE_TAPS - 1 - k);
+	    float t = j - half;
+	    float w = 1.0f - (t / half) * (t / half);
+	    float s = (t == 0) ? 1.0f : sinf((float)M_PI * 2 * fc * t) / ((float)M_PI * 2 * fc * t);
+
+	    c[k] = s * bessel_i0(UPSAMPLE_KAISER_BETA * sqrtf(w > 0 ? w : 0)) / i0_beta;
+	    sum += c[k];
+	}
+	// unity gain at DC for every phase
+	for (int k = 0; k < UPSAMPLE_TAPS; k++) {
+	    upsample_coef[p][k] = lrintf(c[k] / sum * (1 << UPSAMPLE_COEF_BITS));
+	}
+    }
+    upsample_coef_done = true;
+}
+
+// set stream format
+int upsample_set_format(int rate, int channels)
+{
+    int out_rate = rate;
+
+    _lock_acquire(&upsample_lock);
+    upsample_channels = (channels == 1) ? 1 : 2;
+    upsample_m = 0;
+    if (rate * UPSAMPLE_L == UPSAMPLE_OUT_RATE || rate * UPSAMPLE_L == UPSAMPLE_OUT_RATE * 2) {
+	upsample_m = rate * UPSAMPLE_L / UPSAMPLE_OUT_RATE;
+	out_rate = UPSAMPLE_OUT_RATE;
+	if (!upsample_coef_done) {
+	    upsample_make_coef();
+	}
+    }
+    memset(upsample_hist, 0, sizeof(upsample_hist));
+    upsample_hist_pos = 0;
+    upsample_phase = 0;
+    _lock_release(&upsample_lock);
+    return out_rate;
+}
+
+// number of channels of the stream
+int upsample_get_channels(void)
+{
+    return upsample_channels;
+}
+
+// whether the stream needs conversion
+bool upsample_active(void)
+{
+    return upsample_m != 0 || upsample_channels == 1;
+}
+
+// filter output of one phase
+static inline int16_t upsample_dot(const int16_t *x, const int16_t *c)
+{
+    int32_t acc = 1 << (UPSAMPLE_COEF_BITS - 1);
+
+    for (int k = 0; k < UPSAMPLE_TAPS; k++) {
+	acc += x[k] * c[k];
+    }
+    acc >>= UPSAMPLE_COEF_BITS;
+    return (acc > INT16_MAX) ? INT16_MAX : (acc < INT16_MIN) ? INT16_MIN : acc;
+}
+
+// convert 16bit PCM data to stereo at the output rate
+size_t upsample_process(const int16_t *in, size_t *in_frames, int16_t *out, size_t out_frames)
+{
+    const int channels = upsample_channels;
+    size_t i = 0, o = 0;
+
+    _lock_acquire(&upsample_lock);
+
+    if (upsample_m == 0) {
+	// same rate, mono is duplicated
+	o = (*in_frames < out_frames) ? *in_frames : out_frames;
+	if (channels == 2) {
+	    memcpy(out, in, o * 2 * sizeof(int16_t));
+	} else {
+	    for (i = 0; i < o; i++) {
+		out[i * 2] = out[i * 2 + 1] = in[i];
+	    }
+	}
+	*in_frames = o;
+	_lock_release(&upsample_lock);
+	return o;
+    }
+
+    for (;;) {
+	// output samples located before the next input sample
+	while (upsample_phase < UPSAMPLE_L) {
+	    const int16_t *c = upsample_coef[upsample_phase];
+
+	    if (o >= out_frames) {
+		goto done;
+	    }
+	    out[o * 2] = upsample_dot(&upsample_hist[0][upsample_hist_pos], c);
+	    out[o * 2 + 1] = (channels == 2) ? upsample_dot(&upsample_hist[1][upsample_hist_pos], c) : out[o * 2];
+	    o++;
+	    upsample_phase += upsample_m;
+	}
+
+	// advance to the next input sample
+	if (i >= *in_frames) {
+	    break;
+	}
+	for (int ch = 0; ch < channels; ch++) {
+	    upsample_hist[ch][upsample_hist_pos] = upsample_hist[ch][upsample_hist_pos + UPSAMPLE_TAPS] =
+		in[i * channels + ch];
+	}
+	upsample_hist_pos = (upsample_hist_pos + 1) % UPSAMPLE_TAPS;
+	upsample_phase -= UPSAMPLE_L;
+	i++;
+    }
+
+done:
+    _lock_release(&upsample_lock);
+    *in_frames = i;
+    return o;
+}
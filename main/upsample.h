@@ -0,0 +1,51 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+#ifndef __UPSAMPLE_H__
+#define __UPSAMPLE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Conversion of low-rate and mono A2DP streams to what every S/PDIF
+ * receiver takes: 16kHz and 32kHz are converted to 48kHz by a fixed
+ * ratio (3 and 3/2) polyphase filter, mono is output as stereo. Other
+ * streams are passed as they are.
+ */
+
+/*
+ * set stream format, resets the converter state
+ *   rate: stream sampling rate, 16000Hz, 32000Hz, 44100Hz or 48000Hz
+ *   channels: 1 for mono, 2 for stereo (including dual channel)
+ *   return: output sampling rate
+ */
+int upsample_set_format(int rate, int channels);
+
+/*
+ * number of channels of the stream
+ */
+int upsample_get_channels(void);
+
+/*
+ * whether the stream needs conversion (low rate or mono)
+ */
+bool upsample_active(void);
+
+/*
+ * convert 16bit PCM data of the stream to stereo at the output rate
+ *   in: input data
+ *   in_frames: number of input frames (samples for mono), updated to the
+ *              number of consumed frames
+ *   out: output buffer
+ *   out_frames: size of output buffer in stereo frames
+ *   return: number of output frames
+ */
+size_t upsample_process(const int16_t *in, size_t *in_frames, int16_t *out, size_t out_frames);
+
+#endif /* __UPSAMPLE_H__ */
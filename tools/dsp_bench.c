@@ -0,0 +1,191 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * Cost and response of main/dsp.c on the host
+ *
+ * Audio is processed in chunks like the I2S task does, with 0 to DSP_BANDS
+ * active peaking bands, and dsp_cycles_per_frame() is reported per band
+ * count. On x86 hosts these are time stamp counter cycles, which run at
+ * the nominal clock and are not ESP32 cycles. The time per frame includes
+ * generating the test signal (the 0 band line). The gain of peaking,
+ * shelf and high-pass bands is checked against the design value, the
+ * shelves well inside the shelf, and a boost beyond the fixed-point range
+ * must be rejected by dsp_set_band(). Build from the project root, optionally with
+ * -DCONFIG_SPDIF_DSP_BANDS=n:
+ *
+ *   cc -O2 -Imain -o dsp_bench tools/dsp_bench.c main/dsp.c -lm
+ *
+ * Usage:
+ *
+ *   dsp_bench [-r rate]
+ *
+ *   -r: sampling rate (44100)
+ *
+ * Exit status is 1 when a gain is off by more than 0.1dB or the out of
+ * range boost is accepted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "dsp.h"
+
+#define BENCH_CHUNK		128		// frames per call, as the I2S task
+#define BENCH_SECONDS		4		// audio time per band count
+#define BENCH_TOL_DB		0.1
+
+static int16_t bench_buf[BENCH_CHUNK * 2];
+static int rate = 44100;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// fill a chunk with a sine, or noise when freq is 0
+static void bench_fill(double freq, double amp, long *pos)
+{
+    for (int k = 0; k < BENCH_CHUNK; k++, (*pos)++) {
+	double v = freq ? amp * sin(2 * M_PI * freq * *pos / rate) : amp * (rand() / (RAND_MAX + 1.0) - 0.5);
+
+	bench_buf[k * 2] = bench_buf[k * 2 + 1] = lrint(v);
+    }
+}
+
+// bypass all bands and let the crossfade pass
+static void bench_reset(void)
+{
+    long pos = 0;
+
+    for (int i = 0; i < DSP_BANDS; i++) {
+	dsp_set_band(i, DSP_BYPASS, 1000, 0, 1);
+    }
+    for (int i = 0; i < 4; i++) {
+	bench_fill(0, 0, &pos);
+	dsp_process(bench_buf, BENCH_CHUNK);
+    }
+}
+
+// gain in dB of the configured bands at freq
+static double bench_gain(double freq)
+{
+    const double amp = 4000;	// room for +12dB
+    double sum = 0;
+    long pos = 0;
+    int n = 0;
+
+    for (int i = 0; i < rate / BENCH_CHUNK; i++) {
+	bench_fill(freq, amp, &pos);
+	dsp_process(bench_buf, BENCH_CHUNK);
+	if (i >= rate / BENCH_CHUNK / 2) {
+	    // settled, measure the second half second
+	    for (int k = 0; k < BENCH_CHUNK; k++, n++) {
+		sum += (double)bench_buf[k * 2] * bench_buf[k * 2];
+	    }
+	}
+    }
+    return 20 * log10(sqrt(sum / n) / (amp / sqrt(2)));
+}
+
+int main(int argc, char **argv)
+{
+    int opt, fail = 0;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+	switch (opt) {
+	case 'r': rate = atoi(optarg); break;
+	default:
+	    fprintf(stderr, "usage: %s [-r rate]\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (rate < 8000) {
+	fprintf(stderr, "rate out of range\n");
+	return 2;
+    }
+    dsp_set_rate(rate);
+
+    printf("%d Hz, %d bands\n", rate, DSP_BANDS);
+    printf("%6s %14s %14s %12s\n", "bands", "cycles/frame", "per band", "ns/frame");
+    uint32_t base = 0;
+
+    for (int bands = 0; bands <= DSP_BANDS; bands++) {
+	long pos = 0, frames = 0;
+
+	bench_reset();
+	for (int i = 0; i < bands; i++) {
+	    dsp_set_band(i, DSP_PEAK, 200.0f * (i + 1), 3, 1);
+	}
+	double start = bench_now();
+
+	while (frames < (long)rate * BENCH_SECONDS) {
+	    bench_fill(0, 16000, &pos);
+	    dsp_process(bench_buf, BENCH_CHUNK);
+	    frames += BENCH_CHUNK;
+	}
+	double ns = (bench_now() - start) * 1e9 / frames;
+	uint32_t cycles = bands ? dsp_cycles_per_frame() : 0;
+
+	if (bands == 1) {
+	    base = cycles;
+	}
+	if (bands <= 1) {
+	    printf("%6d %14u %14s %12.1f\n", bands, cycles, "-", ns);
+	} else {
+	    printf("%6d %14u %14.1f %12.1f\n", bands, cycles, (double)(cycles - base) / (bands - 1), ns);
+	}
+    }
+
+    // response at the design frequencies
+    struct {
+	dsp_filter_t type;
+	float freq, gain;
+	double expect;
+	const char *name;
+	double at;		// measured here
+    } checks[] = {
+	{ DSP_PEAK, 1000, 6, 6, "peak +6dB at 1kHz", 1000 },
+	{ DSP_PEAK, 5000, -9, -9, "peak -9dB at 5kHz", 5000 },
+	{ DSP_HIGHPASS, 100, 0, -3.01, "high-pass 100Hz Q0.707", 100 },
+	{ DSP_HIGHSHELF, 200, 12, 12, "high shelf +12dB 200Hz", 8000 },
+	{ DSP_HIGHSHELF, 200, -12, -12, "high shelf -12dB 200Hz", 8000 },
+	{ DSP_LOWSHELF, 2000, 12, 12, "low shelf +12dB 2kHz", 50 },
+	{ DSP_LOWSHELF, 2000, -12, -12, "low shelf -12dB 2kHz", 50 },
+    };
+
+    for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+	bench_reset();
+	float q = (checks[i].type == DSP_PEAK) ? 1 : 0.707f;
+
+	if (dsp_set_band(0, checks[i].type, checks[i].freq, checks[i].gain, q) < 0) {
+	    printf("%-24s rejected\n", checks[i].name);
+	    fail = 1;
+	    continue;
+	}
+	double g = bench_gain(checks[i].at);
+
+	printf("%-24s %7.2f dB at %5.0fHz (%.2f)\n", checks[i].name, g, checks[i].at, checks[i].expect);
+	if (fabs(g - checks[i].expect) > BENCH_TOL_DB) {
+	    fail = 1;
+	}
+    }
+    if (dsp_set_band(0, DSP_HIGHSHELF, 200, 36, 0.707f) == 0) {
+	printf("high shelf +36dB accepted\n");
+	fail = 1;
+    } else {
+	printf("high shelf +36dB rejected\n");
+    }
+    return fail;
+}
@@ -0,0 +1,281 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * PCM tap receiver on the host
+ *
+ * Reads the frames sent by the PCM tap (main/pcm_tap.h) from a file or
+ * a serial port and writes the PCM data to a 16bit stereo WAV file.
+ * Bytes that are not a frame with a good CRC (e.g. log output on the
+ * same UART) are skipped. Dropped records are filled by silence, and a
+ * cue point labeled with the gap length marks each gap, as well as a
+ * restart of the sequence (the sink was reset) and a rate change (the
+ * WAV file keeps the first rate).
+ *
+ *   cc -O2 -Imain -o pcm_tap_rx tools/pcm_tap_rx.c main/pcm_tap.c
+ *
+ * Usage:
+ *
+ *   pcm_tap_rx in out.wav
+ *
+ *   in: a file, a serial port or - for stdin, e.g. with
+ *       stty -F /dev/ttyUSB0 3000000 raw
+ *
+ * Reading stops at the end of the input or by Ctrl-C, then the WAV
+ * file is completed. Exit status is 1 when no frame was found.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include "pcm_tap.h"
+
+#define MAX_GAP_RECORDS	(60 * 48000 / PCM_TAP_FRAMES)	// longer gaps are not filled, about 1 min
+#define LABEL_SIZE	48
+
+typedef struct {
+    uint32_t offset;		// frame position in the WAV data
+    char label[LABEL_SIZE];
+} cue_t;
+
+static volatile sig_atomic_t stop;
+static cue_t *cues;
+static size_t cue_count;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static void le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void le32(uint8_t *p, uint32_t v)
+{
+    le16(p, v);
+    le16(p + 2, v >> 16);
+}
+
+static uint32_t rd16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return rd16(p) | (rd16(p + 2) << 16);
+}
+
+// write WAV header, sizes are patched by wav_finish()
+static void wav_header(FILE *f, int rate, uint32_t data_size, uint32_t extra_size)
+{
+    uint8_t h[44];
+
+    memcpy(h, "RIFF", 4);
+    le32(h + 4, 36 + data_size + extra_size);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    le32(h + 16, 16);
+    le16(h + 20, 1);			// PCM
+    le16(h + 22, 2);			// stereo
+    le32(h + 24, rate);
+    le32(h + 28, rate * 4);
+    le16(h + 32, 4);
+    le16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    le32(h + 40, data_size);
+    fwrite(h, 1, sizeof(h), f);
+}
+
+static void add_cue(uint32_t offset, const char *label)
+{
+    cue_t *c = realloc(cues, (cue_count + 1) * sizeof(*cues));
+
+    if (!c) {
+	return;
+    }
+    cues = c;
+    cues[cue_count].offset = offset;
+    snprintf(cues[cue_count].label, LABEL_SIZE, "%s", label);
+    cue_count++;
+}
+
+/*
+ * append the cue chunk and the labels (LIST adtl), patch the sizes
+ *   cue point: id, position, "data", chunk start, block start, offset
+ */
+static void wav_finish(FILE *f, int rate, uint32_t data_size)
+{
+    uint32_t list_size = 4;
+    uint32_t extra = 0;
+    uint8_t b[24];
+
+    if (cue_count > 0) {
+	memcpy(b, "cue ", 4);
+	le32(b + 4, 4 + cue_count * 24);
+	le32(b + 8, cue_count);
+	fwrite(b, 1, 12, f);
+	for (size_t i = 0; i < cue_count; i++) {
+	    le32(b, i + 1);
+	    le32(b + 4, cues[i].offset);
+	    memcpy(b + 8, "data", 4);
+	    le32(b + 12, 0);
+	    le32(b + 16, 0);
+	    le32(b + 20, cues[i].offset);
+	    fwrite(b, 1, 24, f);
+	}
+	for (size_t i = 0; i < cue_count; i++) {
+	    list_size += 8 + ((4 + strlen(cues[i].label) + 1 + 1) & ~1);
+	}
+	memcpy(b, "LIST", 4);
+	le32(b + 4, list_size);
+	memcpy(b + 8, "adtl", 4);
+	fwrite(b, 1, 12, f);
+	for (size_t i = 0; i < cue_count; i++) {
+	    size_t len = strlen(cues[i].label) + 1;
+
+	    memcpy(b, "labl", 4);
+	    le32(b + 4, 4 + len);
+	    le32(b + 8, i + 1);
+	    fwrite(b, 1, 12, f);
+	    fwrite(cues[i].label, 1, len, f);
+	    if ((4 + len) & 1) {
+		fputc(0, f);
+	    }
+	}
+	extra = 12 + cue_count * 24 + 8 + list_size;
+    }
+    if (fseek(f, 0, SEEK_SET) == 0) {
+	wav_header(f, rate, data_size, extra);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t buf[PCM_TAP_FRAME_SIZE * 64];
+    static const int16_t zero[PCM_TAP_FRAMES * 2];
+    struct sigaction sa;
+    FILE *in, *out;
+    size_t len = 0, pos = 0;
+    uint32_t next_seq = 0, dropped = 0, records = 0, gaps = 0, restarts = 0;
+    uint32_t frames = 0, nonaudio = 0;
+    long skipped = 0, crc_errors = 0;
+    int rate = 0, wav_rate = 44100;
+    bool started = false;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: pcm_tap_rx in out.wav\n");
+	return 1;
+    }
+    in = strcmp(argv[1], "-") ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+	perror(argv[1]);
+	return 1;
+    }
+    if (!(out = fopen(argv[2], "wb"))) {
+	perror(argv[2]);
+	return 1;
+    }
+    setvbuf(in, NULL, _IONBF, 0);
+    wav_header(out, 44100, 0, 0);
+
+    // Ctrl-C ends a blocking read, then the WAV file is completed
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!stop) {
+	const uint8_t *p;
+	size_t n;
+	char label[LABEL_SIZE];
+
+	// keep the unparsed bytes, read more
+	memmove(buf, buf + pos, len - pos);
+	len -= pos;
+	pos = 0;
+	n = fread(buf + len, 1, sizeof(buf) - len, in);
+	if (n == 0) {
+	    break;
+	}
+	len += n;
+
+	while (len - pos >= PCM_TAP_FRAME_SIZE) {
+	    uint32_t seq, r;
+
+	    p = buf + pos;
+	    if (rd32(p) != PCM_TAP_MAGIC || rd16(p + 12) != PCM_TAP_FRAMES) {
+		pos++;
+		skipped++;
+		continue;
+	    }
+	    if (pcm_tap_crc32(0, p, PCM_TAP_FRAME_SIZE - 4) != rd32(p + PCM_TAP_FRAME_SIZE - 4)) {
+		pos++;
+		skipped++;
+		crc_errors++;
+		continue;
+	    }
+	    pos += PCM_TAP_FRAME_SIZE;
+	    seq = rd32(p + 4);
+	    r = rd32(p + 8);
+
+	    if (!started) {
+		rate = wav_rate = r;
+		started = true;
+	    } else if (seq < next_seq) {
+		snprintf(label, sizeof(label), "restart at record %u", seq);
+		add_cue(frames, label);
+		restarts++;
+	    } else if (seq > next_seq) {
+		uint32_t missing = seq - next_seq;
+
+		snprintf(label, sizeof(label), "gap %u frames", missing * PCM_TAP_FRAMES);
+		add_cue(frames, label);
+		gaps++;
+		if (missing > MAX_GAP_RECORDS) {
+		    missing = MAX_GAP_RECORDS;
+		}
+		for (uint32_t i = 0; i < missing; i++) {
+		    fwrite(zero, 1, sizeof(zero), out);
+		}
+		frames += missing * PCM_TAP_FRAMES;
+	    }
+	    if ((int)r != rate) {
+		snprintf(label, sizeof(label), "rate %uHz", r);
+		add_cue(frames, label);
+		fprintf(stderr, "rate changed to %uHz, the WAV file stays at %dHz\n", r, wav_rate);
+		rate = r;
+	    }
+	    if (rd16(p + 14) & PCM_TAP_NONAUDIO) {
+		nonaudio++;
+	    }
+	    // the frame is little endian, so is WAV
+	    fwrite(p + PCM_TAP_HEADER_SIZE, 1, PCM_TAP_FRAMES * 4, out);
+	    frames += PCM_TAP_FRAMES;
+	    records++;
+	    dropped = rd32(p + 16);
+	    next_seq = seq + 1;
+	}
+    }
+
+    wav_finish(out, wav_rate, frames * 4);
+    fclose(out);
+    if (in != stdin) {
+	fclose(in);
+    }
+
+    fprintf(stderr, "%u records, %u frames, %u gaps, %u restarts, %u dropped by the sink, "
+	    "%u non-audio, %ld bytes skipped (%ld CRC errors)\n",
+	    records, frames, gaps, restarts, dropped, nonaudio, skipped, crc_errors);
+    return records ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * Packet loss concealment of main/plc.c on the host
+ *
+ * A test signal is cut into blocks of PLC_BLOCK_FRAMES like the I2S task
+ * writes them, and blocks are dropped by a loss pattern. Each gap is
+ * filled by plc_conceal() as the I2S task does when the ring buffer is
+ * empty, the received blocks pass plc_update(). The error energy against
+ * the original signal is compared with filling the gaps by silence.
+ * Finally the stream ends as on an A2DP suspend, plc_end() is called and
+ * the length of the concealment output is reported. Build from the
+ * project root:
+ *
+ *   cc -O2 -Imain -o plc_sim tools/plc_sim.c main/plc.c -lm
+ *
+ * Usage:
+ *
+ *   plc_sim [-t seconds] [-r rate] [-g min_ms] [-G max_ms] [-l loss]
+ *           [-b burst] [-s seed]
+ *
+ *   -t: length of each test signal (10)
+ *   -r: sampling rate (44100)
+ *   -g, -G: gap length range of the random pattern in ms (2, 9)
+ *   -l: share of lost blocks (0.02)
+ *   -b: mean burst length in blocks of the bursty (Gilbert) pattern (3)
+ *   -s: random seed (1)
+ *
+ * Exit status is 1 when concealment of the tone is not better than
+ * silence, of the chord or noise more than 0.5dB worse than silence, or
+ * the end of the stream takes longer than 3ms to fade.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "plc.h"
+
+#define PLC_BLOCK_FRAMES	96		// as in bt_app_core.c
+#define SIM_END_MAX_MS		3		// fade limit at the end of stream
+#define SIM_WORSE_MAX_DB	0.5		// limit above silence, chord and noise
+
+typedef enum {
+    SIM_TONE,		// 220Hz and 660Hz
+    SIM_CHORD,		// three notes with vibrato
+    SIM_NOISE,		// white noise, nothing to predict
+} sim_signal_t;
+
+static const char *sim_signal_names[] = { "tone", "chord", "noise" };
+
+static int rate = 44100;
+static double gap_min_ms = 2, gap_max_ms = 9;
+static double loss = 0.02, burst = 3;
+
+static double sim_rand(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+// noise of its own, the loss pattern stays the same for every signal
+static double sim_noise(void)
+{
+    static uint32_t x = 2463534242u;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x / 4294967296.0 - 0.5;
+}
+
+// one stereo frame of the test signal
+static void sim_frame(sim_signal_t sig, long n, int16_t *f)
+{
+    double t = (double)n / rate;
+    double l, r;
+
+    switch (sig) {
+    case SIM_TONE:
+	l = r = 0.3 * sin(2 * M_PI * 220 * t) + 0.2 * sin(2 * M_PI * 660 * t);
+	break;
+    case SIM_CHORD:
+	l = r = 0;
+	for (int k = 0; k < 3; k++) {
+	    double f0 = 261.6 * pow(2, (k * 4 - (k > 1)) / 12.0);
+
+	    l += 0.15 * sin(2 * M_PI * f0 * t + 0.002 * f0 * sin(2 * M_PI * 5 * t));
+	}
+	r = l * 0.8;
+	break;
+    default:
+	l = sim_noise();
+	r = sim_noise();
+	break;
+    }
+    f[0] = lrint(l * 32767);
+    f[1] = lrint(r * 32767);
+}
+
+// random pattern: independent gaps of random length, bursty: Gilbert model
+static int sim_gap_blocks(bool bursty)
+{
+    double block_ms = 1000.0 * PLC_BLOCK_FRAMES / rate;
+
+    if (bursty) {
+	int n = 1;
+
+	while (sim_rand() > 1 / burst) {
+	    n++;
+	}
+	return n;
+    }
+    double ms = gap_min_ms + sim_rand() * (gap_max_ms - gap_min_ms);
+    int n = lrint(ms / block_ms);
+
+    return (n < 1) ? 1 : n;
+}
+
+// run one signal and pattern, return the error energy ratio PLC / silence in dB
+static double sim_run(sim_signal_t sig, bool bursty, long frames, int *lost)
+{
+    int16_t in[PLC_BLOCK_FRAMES * 2], out[PLC_BLOCK_FRAMES * 2];
+    double err_plc = 0, err_zero = 0;
+    double mean_gap = bursty ? burst : (gap_min_ms + gap_max_ms) / 2 * rate / 1000 / PLC_BLOCK_FRAMES;
+    int gap = 0;
+
+    plc_reset();
+    *lost = 0;
+    for (long n = 0; n + PLC_BLOCK_FRAMES <= frames; n += PLC_BLOCK_FRAMES) {
+	for (int k = 0; k < PLC_BLOCK_FRAMES; k++) {
+	    sim_frame(sig, n + k, &in[k * 2]);
+	}
+	// start a gap so that the share of lost blocks matches
+	if (gap == 0 && n > rate / 10 && sim_rand() < loss / mean_gap / (1 - loss)) {
+	    gap = sim_gap_blocks(bursty);
+	}
+	if (gap > 0) {
+	    gap--;
+	    (*lost)++;
+	    if (!plc_conceal(out, PLC_BLOCK_FRAMES)) {
+		memset(out, 0, sizeof(out));
+	    }
+	    for (int k = 0; k < PLC_BLOCK_FRAMES * 2; k++) {
+		err_plc += (double)(out[k] - in[k]) * (out[k] - in[k]);
+		err_zero += (double)in[k] * in[k];
+	    }
+	} else {
+	    memcpy(out, in, sizeof(in));
+	    plc_update(out, PLC_BLOCK_FRAMES);
+	    // the crossfade after a gap differs from the original signal
+	    for (int k = 0; k < PLC_BLOCK_FRAMES * 2; k++) {
+		err_plc += (double)(out[k] - in[k]) * (out[k] - in[k]);
+	    }
+	}
+    }
+    return 10 * log10((err_plc + 1) / (err_zero + 1));
+}
+
+// frames of concealment output after the end of the stream
+static long sim_end(void)
+{
+    int16_t in[PLC_BLOCK_FRAMES * 2], out[PLC_BLOCK_FRAMES * 2];
+    long n, last = 0;
+
+    plc_reset();
+    for (n = 0; n < rate / 2; n += PLC_BLOCK_FRAMES) {
+	for (int k = 0; k < PLC_BLOCK_FRAMES; k++) {
+	    sim_frame(SIM_TONE, n + k, &in[k * 2]);
+	}
+	plc_update(in, PLC_BLOCK_FRAMES);
+    }
+    plc_end();
+    for (n = 0; n < rate / 10 && plc_conceal(out, PLC_BLOCK_FRAMES); n += PLC_BLOCK_FRAMES) {
+	for (int k = 0; k < PLC_BLOCK_FRAMES; k++) {
+	    if (out[k * 2] || out[k * 2 + 1]) {
+		last = n + k + 1;
+	    }
+	}
+    }
+    return last;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 10, seed = 1, opt, fail = 0;
+
+    while ((opt = getopt(argc, argv, "t:r:g:G:l:b:s:")) != -1) {
+	switch (opt) {
+	case 't': seconds = atoi(optarg); break;
+	case 'r': rate = atoi(optarg); break;
+	case 'g': gap_min_ms = atof(optarg); break;
+	case 'G': gap_max_ms = atof(optarg); break;
+	case 'l': loss = atof(optarg); break;
+	case 'b': burst = atof(optarg); break;
+	case 's': seed = atoi(optarg); break;
+	default:
+	    fprintf(stderr, "usage: %s [-t seconds] [-r rate] [-g min_ms] [-G max_ms] [-l loss] "
+		    "[-b burst] [-s seed]\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (seconds <= 0 || rate <= 0 || loss <= 0 || loss >= 1 || burst < 1 || gap_max_ms < gap_min_ms) {
+	fprintf(stderr, "parameters out of range\n");
+	return 2;
+    }
+
+    printf("%d Hz, %d ms blocks, %.1f%% loss\n", rate, PLC_BLOCK_FRAMES * 1000 / rate, loss * 100);
+    printf("%-8s %-8s %8s %16s\n", "signal", "pattern", "lost", "PLC vs silence");
+    for (int sig = SIM_TONE; sig <= SIM_NOISE; sig++) {
+	for (int bursty = 0; bursty <= 1; bursty++) {
+	    int lost;
+	    double db;
+
+	    srand(seed);
+	    db = sim_run(sig, bursty, (long)seconds * rate, &lost);
+	    printf("%-8s %-8s %8d %13.1f dB\n", sim_signal_names[sig], bursty ? "bursty" : "random", lost, db);
+	    if ((sig == SIM_TONE && db >= 0) || db > SIM_WORSE_MAX_DB) {
+		fail = 1;
+	    }
+	}
+    }
+
+    long end = sim_end();
+
+    printf("end of stream: faded after %ld frames (%.1f ms)\n", end, 1000.0 * end / rate);
+    if (end > (long)rate * SIM_END_MAX_MS / 1000) {
+	fail = 1;
+    }
+    return fail;
+}
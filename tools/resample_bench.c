@@ -0,0 +1,200 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * Quality and speed of main/resample.c on the host
+ *
+ * A sine of each test frequency is converted in chunks like the I2S task
+ * does. A sine of the same frequency is fitted to the output (least
+ * squares, with offset), the fit gives the gain and the residual the
+ * THD+N. Frequencies above the output Nyquist frequency are reported as
+ * the output level relative to the input (aliasing). The throughput is
+ * the time per output frame of the host build, not of the ESP32. Build
+ * from the project root:
+ *
+ *   cc -O2 -Imain -o resample_bench tools/resample_bench.c main/resample.c -lm
+ *
+ * Usage:
+ *
+ *   resample_bench [-i in_rate] [-o out_rate] [-l level] [-e max_thdn]
+ *
+ *   -i: input rate (44100)
+ *   -o: output rate (48000)
+ *   -l: sine level in dBFS (-6)
+ *   -e: fails when THD+N is above max_thdn dB up to 10kHz (-75)
+ *
+ * Exit status is 1 when the THD+N limit is exceeded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "resample.h"
+
+#define BENCH_CHUNK		128		// input frames per call, as the I2S task
+#define BENCH_IN_FRAMES		32768		// input frames per test tone
+#define BENCH_SKIP		1024		// output frames of the filter transient
+#define BENCH_SPEED_FRAMES	(1 << 22)	// output frames timed
+#define BENCH_THDN_MAX_HZ	10000		// limit checked up to here
+
+static const int bench_freqs[] = {
+    100, 1000, 5000, 10000, 15000, 18000, 19000, 20000, 21000, 23000
+};
+
+static int16_t bench_in[BENCH_IN_FRAMES * 2];
+static int16_t bench_out[BENCH_IN_FRAMES * 2 * 2];
+
+// convert bench_in in chunks, return the number of output frames
+static size_t bench_convert(int in_rate, int out_rate, size_t in_frames, size_t out_size)
+{
+    size_t i = 0, o = 0;
+
+    resample_set_rates(in_rate, out_rate);
+    while (i < in_frames && o < out_size) {
+	size_t n = (in_frames - i < BENCH_CHUNK) ? in_frames - i : BENCH_CHUNK;
+
+	o += resample_process(&bench_in[i * 2], &n, &bench_out[o * 2], out_size - o);
+	i += n;
+    }
+    return o;
+}
+
+// fit a * sin + b * cos + c at frequency f to the left channel
+static void bench_fit(const int16_t *x, size_t n, double w, double *amp, double *resid)
+{
+    double m[3][4] = { { 0 } };
+
+    for (size_t k = 0; k < n; k++) {
+	double v[3] = { sin(w * k), cos(w * k), 1 };
+
+	for (int r = 0; r < 3; r++) {
+	    for (int c = 0; c < 3; c++) {
+		m[r][c] += v[r] * v[c];
+	    }
+	    m[r][3] += v[r] * x[k * 2];
+	}
+    }
+    // Gauss-Jordan elimination, the matrix is well conditioned
+    for (int p = 0; p < 3; p++) {
+	for (int r = 0; r < 3; r++) {
+	    if (r != p) {
+		double f = m[r][p] / m[p][p];
+
+		for (int c = p; c < 4; c++) {
+		    m[r][c] -= f * m[p][c];
+		}
+	    }
+	}
+    }
+    double a = m[0][3] / m[0][0], b = m[1][3] / m[1][1], c = m[2][3] / m[2][2];
+    double sum = 0;
+
+    for (size_t k = 0; k < n; k++) {
+	double e = x[k * 2] - (a * sin(w * k) + b * cos(w * k) + c);
+
+	sum += e * e;
+    }
+    *amp = sqrt(a * a + b * b);
+    *resid = sqrt(sum / n);
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int in_rate = 44100, out_rate = 48000;
+    double level = -6, max_thdn = -75;
+    int opt, fail = 0;
+
+    while ((opt = getopt(argc, argv, "i:o:l:e:")) != -1) {
+	switch (opt) {
+	case 'i': in_rate = atoi(optarg); break;
+	case 'o': out_rate = atoi(optarg); break;
+	case 'l': level = atof(optarg); break;
+	case 'e': max_thdn = atof(optarg); break;
+	default:
+	    fprintf(stderr, "usage: %s [-i in_rate] [-o out_rate] [-l level] [-e max_thdn]\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (in_rate <= 0 || out_rate <= 0 || out_rate > 2 * in_rate) {
+	fprintf(stderr, "rates out of range\n");
+	return 2;
+    }
+
+    double in_amp = 32767 * pow(10, level / 20);
+    int lower_nyquist = ((in_rate < out_rate) ? in_rate : out_rate) / 2;
+
+    printf("%d -> %d Hz, %.1f dBFS\n", in_rate, out_rate, level);
+    printf("%8s %10s %10s\n", "Hz", "gain dB", "THD+N dB");
+    for (size_t t = 0; t < sizeof(bench_freqs) / sizeof(bench_freqs[0]); t++) {
+	int f = bench_freqs[t];
+	double amp, resid;
+
+	if (f >= in_rate / 2) {
+	    continue;
+	}
+	for (int k = 0; k < BENCH_IN_FRAMES; k++) {
+	    bench_in[k * 2] = bench_in[k * 2 + 1] = lrint(in_amp * sin(2 * M_PI * f * k / in_rate));
+	}
+	size_t n = bench_convert(in_rate, out_rate, BENCH_IN_FRAMES, BENCH_IN_FRAMES * 2);
+
+	if (n <= BENCH_SKIP * 2) {
+	    fprintf(stderr, "no output\n");
+	    return 2;
+	}
+	n -= BENCH_SKIP * 2;
+	if (f >= lower_nyquist) {
+	    // nothing should pass, all output is aliasing
+	    double sum = 0;
+
+	    for (size_t k = 0; k < n; k++) {
+		double v = bench_out[(BENCH_SKIP + k) * 2];
+
+		sum += v * v;
+	    }
+	    printf("%8d %10s %10.1f (alias)\n", f, "-", 20 * log10((sqrt(sum / n) + 1e-9) / (in_amp / sqrt(2))));
+	    continue;
+	}
+	bench_fit(&bench_out[BENCH_SKIP * 2], n, 2 * M_PI * f / out_rate, &amp, &resid);
+	double thdn = 20 * log10((resid + 1e-9) / (amp / sqrt(2)));
+
+	printf("%8d %10.2f %10.1f\n", f, 20 * log10(amp / in_amp), thdn);
+	if (f <= BENCH_THDN_MAX_HZ && thdn > max_thdn) {
+	    fail = 1;
+	}
+    }
+
+    // speed, converting the last tone over and over
+    size_t frames = 0;
+    double start = bench_now();
+
+    resample_set_rates(in_rate, out_rate);
+    while (frames < BENCH_SPEED_FRAMES) {
+	for (size_t i = 0; i < BENCH_IN_FRAMES; i += BENCH_CHUNK) {
+	    size_t n = BENCH_CHUNK;
+
+	    frames += resample_process(&bench_in[i * 2], &n, bench_out, BENCH_IN_FRAMES * 2);
+	}
+    }
+    printf("host: %.1f ns per output frame\n", (bench_now() - start) * 1e9 / frames);
+
+    if (fail) {
+	printf("THD+N above %.1f dB\n", max_thdn);
+    }
+    return fail;
+}
@@ -0,0 +1,755 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * WAV <-> S/PDIF bitstream converter on the host
+ *
+ * encode: 16bit stereo WAV -> raw I2S word stream, as written to I2S by
+ *         the driver (native endian 32bit words, 2 words per sample)
+ * decode: raw I2S word stream -> 16bit stereo WAV, the BMC coding,
+ *         preambles and parity are checked
+ * capture: raw I2S word stream -> the signal sampled at another clock,
+ *         as read by the receiver from I2S RX (32 samples per word)
+ * rx:     sampled signal -> 16bit stereo WAV by the receiver's decoder
+ * apll:   checks the APLL table against the solver, fails when an error
+ *         exceeds SPDIF_APLL_MAX_PPB, -t prints the table
+ * iec:    AAC ADTS file -> IEC 61937 data bursts as a 16bit stereo WAV
+ *         file by main/iec61937.c, e.g. for ffmpeg's spdif demuxer
+ *         (ffprobe out.wav), encode -n makes the S/PDIF bitstream of it
+ *
+ * encode -s writes each chunk in pieces of random, also odd, byte size,
+ * as the wrap of a byte ring buffer can split an item. The output must
+ * be the same as without -s.
+ *
+ * With -DCONFIG_SPDIF_TAP (and main/pcm_tap.c) encode -p also writes the
+ * PCM tap frames, as sent by the sink, for tools/pcm_tap_rx.c. The tap
+ * is read after every -k buffers, so a slow consumer drops records.
+ *
+ * The encoder, the receiver's decoder and the APLL solver are
+ * main/spdif_enc.c, main/spdif_dec.c and main/spdif_apll.c themselves.
+ * Build from the project root:
+ *
+ *   cc -O2 -Imain -DCONFIG_SPDIF_SILENCE_CACHE -DCONFIG_SPDIF_LEVEL_METER \
+ *      -o spdif_tool tools/spdif_tool.c main/spdif_enc.c main/spdif_dec.c \
+ *      main/spdif_apll.c main/iec61937.c -lm
+ *
+ * Usage:
+ *
+ *   spdif_tool encode [-n] [-s] [-p tap.bin [-k bufs]] in.wav out.bin
+ *                                           (-n: non-audio, IEC 61937)
+ *   spdif_tool decode [-r rate] in.bin out.wav
+ *   spdif_tool capture [-r rate] [-c clock] [-j jitter_ns] in.bin out.cap
+ *   spdif_tool rx [-c clock] in.cap out.wav
+ *   spdif_tool apll [-x xtal] [-t]
+ *   spdif_tool iec in.aac out.wav
+ *
+ * Data are streamed in fixed size chunks, so the file size is not
+ * limited by memory. The time spent in the encoder and the decoder is
+ * reported separately from the file I/O.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "spdif.h"
+#include "spdif_enc.h"
+#include "spdif_dec.h"
+#include "spdif_apll.h"
+#include "iec61937.h"
+#ifdef CONFIG_SPDIF_TAP
+#include "pcm_tap.h"
+#endif
+
+#define CHUNK_FRAMES	(64 * 1024)		// PCM frames per read
+#define IO_BUF_SIZE	(1024 * 1024)		// stdio buffer
+#define RX_CLOCK	20000000		// default sampling clock of the receiver
+#define APLL_XTAL	40000000		// crystal of the APLL table
+#define ADTS_HEADER	7			// fixed and variable header
+#define ADTS_MAX_SIZE	8192			// 13bit frame_length
+#define IEC_MAX_FRAMES	(IEC61937_AAC_FRAMES * 4)	// longest burst period
+
+// BMC preambles, first half bit low
+#define PRE_B		0x17
+#define PRE_M		0x1d
+#define PRE_W		0x1b
+
+static FILE *out_file;
+static double enc_sec;
+static FILE *tap_file;
+static int tap_every = 1;			// buffers per tap read
+static bool split;				// encode -s
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void le32(uint8_t *p, uint32_t v)
+{
+    le16(p, v);
+    le16(p + 2, v >> 16);
+}
+
+static uint32_t rd16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return rd16(p) | (rd16(p + 2) << 16);
+}
+
+// write WAV header, sizes are patched by wav_finish()
+static void wav_header(FILE *f, int rate, uint32_t data_size)
+{
+    uint8_t h[44];
+
+    memcpy(h, "RIFF", 4);
+    le32(h + 4, 36 + data_size);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    le32(h + 16, 16);
+    le16(h + 20, 1);			// PCM
+    le16(h + 22, 2);			// stereo
+    le32(h + 24, rate);
+    le32(h + 28, rate * 4);
+    le16(h + 32, 4);
+    le16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    le32(h + 40, data_size);
+    fwrite(h, 1, sizeof(h), f);
+}
+
+static void wav_finish(FILE *f, int rate, uint32_t data_size)
+{
+    if (fseek(f, 0, SEEK_SET) == 0) {
+	wav_header(f, rate, data_size);
+    }
+}
+
+// find data chunk of 16bit stereo PCM WAV, return its size
+static long wav_open(FILE *f, int *rate)
+{
+    uint8_t h[12], c[8], fmt[16];
+    bool have_fmt = false;
+
+    if (fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) {
+	return -1;
+    }
+    while (fread(c, 1, 8, f) == 8) {
+	uint32_t size = rd32(c + 4);
+
+	if (!memcmp(c, "fmt ", 4) && size >= 16) {
+	    if (fread(fmt, 1, 16, f) != 16) {
+		return -1;
+	    }
+	    if (rd16(fmt) != 1 || rd16(fmt + 2) != 2 || rd16(fmt + 14) != 16) {
+		fprintf(stderr, "only 16bit stereo PCM is supported\n");
+		return -1;
+	    }
+	    *rate = rd32(fmt + 4);
+	    have_fmt = true;
+	    size -= 16;
+	} else if (!memcmp(c, "data", 4)) {
+	    return have_fmt ? (long)size : -1;
+	}
+	if (fseek(f, (size + 1) & ~1, SEEK_CUR)) {
+	    return -1;
+	}
+    }
+    return -1;
+}
+
+// write the records of the PCM tap
+static void tap_read(void)
+{
+#ifdef CONFIG_SPDIF_TAP
+    uint8_t frame[PCM_TAP_FRAME_SIZE];
+    size_t n;
+
+    while ((n = pcm_tap_get(frame)) > 0) {
+	fwrite(frame, 1, n, tap_file);
+    }
+#endif
+}
+
+// encoder output, called for every half block
+static void file_output(const uint32_t *buf, size_t size)
+{
+    static long bufs;
+    double t = now();
+
+    fwrite(buf, 1, size, out_file);
+    if (tap_file && ++bufs % tap_every == 0) {
+	tap_read();
+    }
+    enc_sec -= now() - t;		// not encoding time
+}
+
+static int encode(const char *in_name, const char *out_name, bool nonaudio, const char *tap_name)
+{
+    FILE *in = fopen(in_name, "rb");
+    int16_t *pcm = malloc(CHUNK_FRAMES * 4);
+    long remain;
+    size_t n, frames = 0;
+    int rate = 0;
+    double t;
+
+    if (!in || !pcm) {
+	perror(in_name);
+	return 1;
+    }
+    if ((remain = wav_open(in, &rate)) < 0) {
+	fprintf(stderr, "%s: not a 16bit stereo WAV file\n", in_name);
+	return 1;
+    }
+    if (!(out_file = fopen(out_name, "wb"))) {
+	perror(out_name);
+	return 1;
+    }
+    setvbuf(in, NULL, _IOFBF, IO_BUF_SIZE);
+    setvbuf(out_file, NULL, _IOFBF, IO_BUF_SIZE);
+    if (tap_name) {
+#ifdef CONFIG_SPDIF_TAP
+	if (!(tap_file = fopen(tap_name, "wb"))) {
+	    perror(tap_name);
+	    return 1;
+	}
+	pcm_tap_init();
+#else
+	fprintf(stderr, "built without CONFIG_SPDIF_TAP\n");
+	return 1;
+#endif
+    }
+
+    spdif_set_nonaudio(nonaudio);
+    spdif_enc_init(rate, file_output);
+
+    t = now();
+    while (remain >= 4) {
+	double t0;
+
+	// chunks after the data chunk (LIST, id3) are not audio
+	n = (remain / 4 < CHUNK_FRAMES) ? remain / 4 : CHUNK_FRAMES;
+	if ((n = fread(pcm, 4, n, in)) == 0) {
+	    break;
+	}
+	t0 = now();
+
+	// WAV is little endian, so is the driver's PCM input
+	if (split) {
+	    for (size_t k = 0, len; k < n * 4; k += len) {
+		len = 1 + rand() % 255;
+		len = (len < n * 4 - k) ? len : n * 4 - k;
+		spdif_write((uint8_t *)pcm + k, len);
+	    }
+	} else {
+	    spdif_write(pcm, n * 4);
+	}
+	enc_sec += now() - t0;
+	frames += n;
+	remain -= n * 4;
+    }
+    // pad the last half block
+    if (frames % (SPDIF_BLOCK_SAMPLES / SPDIF_BUF_DIV)) {
+	spdif_write_silence();
+    }
+    t = now() - t;
+
+    spdif_levels_t levels;
+    if (spdif_get_levels(&levels)) {
+	fprintf(stderr, "clipped samples: %u %u\n", levels.clips[0], levels.clips[1]);
+    }
+    fprintf(stderr, "%zu frames at %dHz, encoder %.1f ns/frame (%.0fx real time), total %.1fs\n",
+	    frames, rate, frames ? enc_sec * 1e9 / frames : 0, enc_sec > 0 ? frames / enc_sec / rate : 0, t);
+
+#ifdef CONFIG_SPDIF_TAP
+    if (tap_file) {
+	tap_read();
+	fprintf(stderr, "tap: %u records dropped\n", pcm_tap_get_dropped());
+	fclose(tap_file);
+    }
+#endif
+
+    fclose(in);
+    fclose(out_file);
+    free(pcm);
+    return 0;
+}
+
+/*
+ * BMC decoder state, a subframe is 64 half bits: VUCP of the previous
+ * subframe (8), preamble (8), aux and 4 LSbs (16), 16bit sample (32)
+ */
+typedef struct {
+    uint64_t prev, prev_t;		// previous subframe and its transitions
+    bool have_prev;
+    long subframes, blocks;
+    long bmc_errors, preamble_errors, parity_errors;
+} bmc_dec_t;
+
+/*
+ * Transitions between half bits, t = h ^ (h >> 1). A BMC slot starts
+ * with a transition (odd bits of t) and has data 1 when it changes in
+ * the middle (even bits of t).
+ */
+#define BMC_CLOCK_MASK	0x2aaaaaaaaaaaaaaaULL
+#define BMC_PRE_MASK	0x002a000000000000ULL	// inside preamble
+
+static uint8_t slot_tab[256];			// transitions of 4 slots -> 4 data bits
+
+static void bmc_dec_init(void)
+{
+    for (int b = 0; b < 256; b++) {
+	for (int k = 0; k < 4; k++) {
+	    slot_tab[b] |= ((b >> (6 - k * 2)) & 1) << k;
+	}
+    }
+}
+
+// decode BMC data slots, LSb first, first and slots are multiples of 8 and 4
+static uint32_t bmc_bits(uint64_t t, int first, int slots)
+{
+    uint32_t v = 0;
+
+    for (int i = 0; i < slots; i += 4) {
+	v |= slot_tab[(t >> (56 - first - i * 2)) & 0xff] << i;
+    }
+    return v;
+}
+
+static int16_t bmc_decode(bmc_dec_t *d, uint32_t w0, uint32_t w1)
+{
+    uint64_t h = ((uint64_t)w0 << 32) | w1;
+    uint64_t t = h ^ (h >> 1);
+    uint8_t pre = (w0 >> 16) & 0xff;
+
+    if (pre & 0x80) {
+	pre = ~pre;			// preamble after a high level
+    }
+    if (pre == PRE_B) {
+	d->blocks++;
+    } else if (pre != PRE_M && pre != PRE_W) {
+	d->preamble_errors++;
+    }
+    if ((t & (BMC_CLOCK_MASK & ~BMC_PRE_MASK)) != (BMC_CLOCK_MASK & ~BMC_PRE_MASK) ||
+	(d->have_prev && !((d->prev ^ (h >> 63)) & 1))) {
+	d->bmc_errors++;
+    }
+
+    // parity of the previous subframe: its data and its VUCP in this one
+    if (d->have_prev) {
+	uint32_t data = bmc_bits(d->prev_t, 16, 24) ^ bmc_bits(t, 0, 4);
+
+	if (__builtin_parity(data)) {
+	    d->parity_errors++;
+	}
+    }
+    d->prev = h;
+    d->prev_t = t;
+    d->have_prev = true;
+    d->subframes++;
+
+    return bmc_bits(t, 32, 16);
+}
+
+static int decode(const char *in_name, const char *out_name, int rate)
+{
+    FILE *in = fopen(in_name, "rb");
+    FILE *out = fopen(out_name, "wb");
+    uint32_t *words = malloc(CHUNK_FRAMES * 4 * sizeof(uint32_t));
+    int16_t *pcm = malloc(CHUNK_FRAMES * 4);
+    bmc_dec_t dec = { 0 };
+    size_t n, frames = 0;
+    double dec_sec = 0;
+
+    if (!in || !out || !words || !pcm) {
+	perror(!in ? in_name : out_name);
+	return 1;
+    }
+    setvbuf(in, NULL, _IOFBF, IO_BUF_SIZE);
+    setvbuf(out, NULL, _IOFBF, IO_BUF_SIZE);
+    wav_header(out, rate, 0);
+    bmc_dec_init();
+
+    while ((n = fread(words, 4 * sizeof(uint32_t), CHUNK_FRAMES, in)) > 0) {
+	double t0 = now();
+
+	for (size_t i = 0; i < n * 2; i++) {
+	    pcm[i] = bmc_decode(&dec, words[i * 2], words[i * 2 + 1]);
+	}
+	dec_sec += now() - t0;
+	fwrite(pcm, 4, n, out);
+	frames += n;
+    }
+    wav_finish(out, rate, frames * 4);
+
+    fprintf(stderr, "%zu frames, %ld blocks, errors: BMC %ld, preamble %ld, parity %ld, decoder %.1f ns/frame\n",
+	    frames, dec.blocks, dec.bmc_errors, dec.preamble_errors, dec.parity_errors,
+	    frames ? dec_sec * 1e9 / frames : 0);
+
+    fclose(in);
+    fclose(out);
+    free(words);
+    free(pcm);
+    return (dec.bmc_errors || dec.preamble_errors || dec.parity_errors) ? 2 : 0;
+}
+
+// edge jitter of the transmitter, uniform in +-1, fixed per half bit
+static double edge_jitter(size_t h)
+{
+    uint32_t x = h * 2654435761u;
+
+    x ^= x >> 15;
+    x *= 2246822519u;
+    x ^= x >> 13;
+    return x * (2.0 / UINT32_MAX) - 1;
+}
+
+/*
+ * Sample the half bit stream at the receiver's clock. Half bit n is
+ * bit 31 - n % 32 of word n / 32, it starts at time n plus the edge
+ * jitter.
+ */
+static int capture(const char *in_name, const char *out_name, int rate, int clock, double jitter_ns)
+{
+    FILE *in = fopen(in_name, "rb");
+    FILE *out = fopen(out_name, "wb");
+    uint32_t *words, *cap;
+    double step = (double)rate * 128 / clock;		// half bits per sample
+    double jitter = jitter_ns * 1e-9 * rate * 128;	// in half bits
+    double t = 0;
+    size_t base = 0, count = 0;				// words[0] is word base of the input
+    size_t n = 0, samples = 0;
+
+    if (!in || !out) {
+	perror(!in ? in_name : out_name);
+	return 1;
+    }
+    words = malloc((CHUNK_FRAMES + 2) * sizeof(uint32_t));
+    cap = malloc(CHUNK_FRAMES * sizeof(uint32_t));
+    if (!words || !cap) {
+	perror("malloc");
+	return 1;
+    }
+    setvbuf(in, NULL, _IOFBF, IO_BUF_SIZE);
+    setvbuf(out, NULL, _IOFBF, IO_BUF_SIZE);
+
+    for (;;) {
+	uint32_t w = 0;
+
+	for (int i = 0; i < 32; i++, t += step) {
+	    size_t h = t;
+
+	    // stream the input, keep the previous word for a late edge
+	    while ((h + 1) / 32 >= base + count) {
+		size_t keep = (count < 2) ? count : 2;
+		size_t got;
+
+		memmove(words, words + count - keep, keep * sizeof(uint32_t));
+		base += count - keep;
+		count = keep;
+		if ((got = fread(words + count, sizeof(uint32_t), CHUNK_FRAMES, in)) == 0) {
+		    goto done;
+		}
+		count += got;
+	    }
+	    if (h > 0 && t < h + jitter * edge_jitter(h)) {
+		h--;			// edge is late
+	    } else if (t >= h + 1 + jitter * edge_jitter(h + 1)) {
+		h++;			// next edge is early
+	    }
+	    w = (w << 1) | ((words[h / 32 - base] >> (31 - h % 32)) & 1);
+	}
+	cap[n++] = w;
+	samples += 32;
+	if (n == CHUNK_FRAMES) {
+	    fwrite(cap, sizeof(uint32_t), n, out);
+	    n = 0;
+	}
+    }
+done:
+    fwrite(cap, sizeof(uint32_t), n, out);
+    fprintf(stderr, "%zu samples at %dHz, %.3f samples per half bit, jitter %.2f half bits\n",
+	    samples, clock, 1 / step, jitter);
+
+    fclose(in);
+    fclose(out);
+    free(words);
+    free(cap);
+    return 0;
+}
+
+static size_t rx_frames;
+
+// receiver output
+static void rx_output(const int16_t *pcm, size_t frames)
+{
+    double t = now();
+
+    fwrite(pcm, 4, frames, out_file);
+    rx_frames += frames;
+    enc_sec -= now() - t;		// not decoding time
+}
+
+static int rx(const char *in_name, const char *out_name, int clock)
+{
+    FILE *in = fopen(in_name, "rb");
+    uint32_t *cap = malloc(CHUNK_FRAMES * sizeof(uint32_t));
+    spdif_dec_status_t st;
+    size_t n, samples = 0;
+
+    if (!in || !cap) {
+	perror(in_name);
+	return 1;
+    }
+    if (!(out_file = fopen(out_name, "wb"))) {
+	perror(out_name);
+	return 1;
+    }
+    setvbuf(in, NULL, _IOFBF, IO_BUF_SIZE);
+    setvbuf(out_file, NULL, _IOFBF, IO_BUF_SIZE);
+    wav_header(out_file, 0, 0);
+    spdif_dec_init(clock, rx_output);
+
+    while ((n = fread(cap, sizeof(uint32_t), CHUNK_FRAMES, in)) > 0) {
+	double t0 = now();
+
+	spdif_dec_process(cap, n);
+	enc_sec += now() - t0;
+	samples += n * 32;
+    }
+    spdif_dec_get_status(&st);
+    wav_finish(out_file, st.rate ? st.rate : (int)st.measured_rate, rx_frames * 4);
+
+    fprintf(stderr, "%s, %dHz (measured %uHz)%s, %u frames, %u errors, %u unlocks\n",
+	    st.locked ? "locked" : "not locked", st.rate, st.measured_rate,
+	    st.nonaudio ? ", non-audio" : "", st.frames, st.errors, st.unlocks);
+    fprintf(stderr, "channel status:");
+    for (int i = 0; i < sizeof(st.cstatus); i++) {
+	fprintf(stderr, " %02x", st.cstatus[i]);
+    }
+    fprintf(stderr, "\ndecoder %.1f ns/frame, %.1f%% of real time\n",
+	    st.frames ? enc_sec * 1e9 / st.frames : 0, samples ? enc_sec * clock / samples * 100 : 0);
+
+    fclose(in);
+    fclose(out_file);
+    free(cap);
+    return st.locked ? 0 : 2;
+}
+
+// AAC ADTS file -> IEC 61937 bursts in a WAV file
+static int iec(const char *in_name, const char *out_name)
+{
+    static uint8_t adts[ADTS_MAX_SIZE];
+    static int16_t burst[IEC_MAX_FRAMES * 2];
+    static uint8_t wav[IEC_MAX_FRAMES * 4];
+    FILE *in = fopen(in_name, "rb");
+    size_t len = 0, frames = 0, payload = 0;
+    long bursts = 0, unsupported = 0, skipped = 0;
+    int rate = 0;
+
+    if (!in) {
+	perror(in_name);
+	return 1;
+    }
+    if (!(out_file = fopen(out_name, "wb"))) {
+	perror(out_name);
+	return 1;
+    }
+    setvbuf(in, NULL, _IOFBF, IO_BUF_SIZE);
+    setvbuf(out_file, NULL, _IOFBF, IO_BUF_SIZE);
+    wav_header(out_file, 48000, 0);
+
+    for (;;) {
+	size_t size, n;
+	int r;
+
+	// header, skip bytes up to the next syncword
+	len += fread(adts + len, 1, ADTS_HEADER - len, in);
+	if (len < ADTS_HEADER) {
+	    break;
+	}
+	size = ((adts[3] & 0x03) << 11) | (adts[4] << 3) | (adts[5] >> 5);
+	if (adts[0] != 0xff || (adts[1] & 0xf6) != 0xf0 || size < ADTS_HEADER) {
+	    memmove(adts, adts + 1, --len);
+	    skipped++;
+	    continue;
+	}
+	if (fread(adts + ADTS_HEADER, 1, size - ADTS_HEADER, in) != size - ADTS_HEADER) {
+	    break;
+	}
+	len = 0;
+
+	if ((n = iec61937_frame_aac(burst, IEC_MAX_FRAMES, adts, size)) == 0) {
+	    unsupported++;
+	    continue;
+	}
+	iec61937_aac_info(adts, size, &r);
+	if (rate == 0) {
+	    rate = r;
+	} else if (r != rate) {
+	    fprintf(stderr, "sampling rate changed from %dHz to %dHz, stopped\n", rate, r);
+	    break;
+	}
+	// the burst is sent as 16bit PCM, WAV is little endian
+	for (size_t i = 0; i < n * 2; i++) {
+	    le16(wav + i * 2, burst[i]);
+	}
+	fwrite(wav, 4, n, out_file);
+	frames += n;
+	payload += size;
+	bursts++;
+    }
+
+    wav_finish(out_file, rate ? rate : 48000, frames * 4);
+    fclose(out_file);
+    fclose(in);
+    fprintf(stderr, "%ld bursts, %zu frames at %dHz, payload %.1f%% of the bursts, "
+	    "%ld frames not supported, %ld bytes skipped\n",
+	    bursts, frames, rate, frames ? payload * 100.0 / (frames * 4) : 0, unsupported, skipped);
+    return bursts ? 0 : 1;
+}
+
+static const int apll_rates[] = { 32000, 44100, 48000 };
+
+// master clock in Hz, the APLL output divided by the I2S clock divider
+static double apll_freq(const spdif_apll_coef_t *c)
+{
+    return c->xtal * (4 + c->sdm2 + c->sdm1 / 256.0 + c->sdm0 / 65536.0) / (2 * (c->o_div + 2)) /
+	SPDIF_APLL_I2S_DIV;
+}
+
+static int apll(int xtal, bool table)
+{
+    const spdif_apll_coef_t *tab;
+    int count, fail = 0;
+
+    tab = spdif_apll_table(&count);
+    for (int i = 0; i < sizeof(apll_rates) / sizeof(apll_rates[0]); i++) {
+	uint32_t mclk = spdif_apll_mclk(apll_rates[i]);
+	spdif_apll_coef_t c, t;
+	const char *check = "";
+	bool dup = false;
+
+	for (int j = 0; j < i; j++) {
+	    dup |= spdif_apll_mclk(apll_rates[j]) == mclk;
+	}
+	if (!spdif_apll_solve(xtal, mclk, &c)) {
+	    printf("%6dHz mclk %uHz: out of range\n", apll_rates[i], mclk);
+	    fail = 1;
+	    continue;
+	}
+	if (table) {
+	    if (!dup) {
+		printf("    { %u, %u, %u, %u, %u, %u, %d },\n",
+		       c.xtal, c.mclk, c.sdm0, c.sdm1, c.sdm2, c.o_div, c.error_ppb);
+	    }
+	    continue;
+	}
+	if (xtal == APLL_XTAL) {
+	    // the table must hold the solution for the supported rates
+	    check = " table missing";
+	    for (int j = 0; j < count; j++) {
+		t = tab[j];
+		if (t.xtal == c.xtal && t.mclk == c.mclk) {
+		    check = memcmp(&t, &c, sizeof(t)) ? " table mismatch" : " table ok";
+		}
+	    }
+	    fail |= strcmp(check, " table ok") != 0;
+	}
+	if (abs(c.error_ppb) > SPDIF_APLL_MAX_PPB) {
+	    check = " error too large";
+	    fail = 1;
+	}
+	printf("%6dHz mclk %uHz: sdm2 %2u sdm1 %3u sdm0 %3u o_div %2u -> %.4fHz, %+.3fppm%s\n",
+	       apll_rates[i], mclk, c.sdm2, c.sdm1, c.sdm0, c.o_div, apll_freq(&c),
+	       c.error_ppb / 1000.0, check);
+    }
+    return fail;
+}
+
+static int usage(void)
+{
+    fprintf(stderr, "usage: spdif_tool encode [-n] [-s] [-p tap.bin [-k bufs]] in.wav out.bin\n"
+	    "       spdif_tool decode [-r rate] in.bin out.wav\n"
+	    "       spdif_tool capture [-r rate] [-c clock] [-j jitter_ns] in.bin out.cap\n"
+	    "       spdif_tool rx [-c clock] in.cap out.wav\n"
+	    "       spdif_tool apll [-x xtal] [-t]\n"
+	    "       spdif_tool iec in.aac out.wav\n");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    bool nonaudio = false;
+    int rate = 44100;
+    int clock = RX_CLOCK;
+    int xtal = APLL_XTAL;
+    bool table = false;
+    const char *tap_name = NULL;
+    double jitter = 0;
+    int i = 2;
+
+    if (argc < 2) {
+	return usage();
+    }
+    for (; i < argc && argv[i][0] == '-'; i++) {
+	if (!strcmp(argv[i], "-n")) {
+	    nonaudio = true;
+	} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+	    rate = atoi(argv[++i]);
+	} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+	    clock = atoi(argv[++i]);
+	} else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+	    jitter = atof(argv[++i]);
+	} else if (!strcmp(argv[i], "-x") && i + 1 < argc) {
+	    xtal = atoi(argv[++i]);
+	} else if (!strcmp(argv[i], "-s")) {
+	    split = true;
+	} else if (!strcmp(argv[i], "-t")) {
+	    table = true;
+	} else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+	    tap_name = argv[++i];
+	} else if (!strcmp(argv[i], "-k") && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+	    tap_every = atoi(argv[++i]);
+	} else {
+	    return usage();
+	}
+    }
+    if (!strcmp(argv[1], "apll") && i == argc) {
+	return apll(xtal, table);
+    }
+    if (argc - i != 2) {
+	return usage();
+    }
+
+    if (!strcmp(argv[1], "encode")) {
+	return encode(argv[i], argv[i + 1], nonaudio, tap_name);
+    } else if (!strcmp(argv[1], "decode")) {
+	return decode(argv[i], argv[i + 1], rate);
+    } else if (!strcmp(argv[1], "capture")) {
+	return capture(argv[i], argv[i + 1], rate, clock, jitter);
+    } else if (!strcmp(argv[1], "rx")) {
+	return rx(argv[i], argv[i + 1], clock);
+    } else if (!strcmp(argv[1], "iec")) {
+	return iec(argv[i], argv[i + 1]);
+    }
+    return usage();
+}
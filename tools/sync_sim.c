@@ -0,0 +1,400 @@
+/*
+    This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+    Unless required by applicable law or agreed to in writing, this
+    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+    CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+/*
+ * Synchronized playback of several nodes on the host
+ *
+ * Each node is a process running main/sync.c with its own clock and
+ * crystal error, the packets go through UDP on the loopback interface
+ * with a random extra delay standing in for WiFi. The A2DP source, the
+ * ring buffer and the S/PDIF output are simulated in real time, the
+ * output of a node runs at the nominal rate of its own clock like the
+ * APLL. Every node has its own A2DP source, the master's runs SRC_PPM
+ * fast and the slaves' differ from it by up to src_ppm. The parent
+ * process compares
+ * the stream position played by each slave with the master's at the same
+ * (real) time while the slave is locked. Build from the project root:
+ *
+ *   cc -O2 -Imain -o sync_sim tools/sync_sim.c main/sync.c -lm
+ *
+ * Usage:
+ *
+ *   sync_sim [-n nodes] [-t seconds] [-r rate] [-p ppm] [-S src_ppm]
+ *            [-d delay_us] [-e max_error] [-s seed]
+ *
+ *   -n: number of nodes, node 0 is the master (3)
+ *   -t: simulated time (20)
+ *   -r: sampling rate (44100)
+ *   -p: crystal errors are random within +-ppm (30)
+ *   -S: slave sources differ from the master's by up to +-src_ppm, node 1
+ *       by +src_ppm, node 2 by -src_ppm, the others at random (0)
+ *   -d: mean random network delay in microseconds (500)
+ *   -e: fails when a locked slave is off by more frames after the first
+ *       5s (12)
+ *
+ * Exit status is 1 when a locked slave is off by more than max_error
+ * frames or a ring buffer overflows.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "sync.h"
+
+#define SIM_PORT		46000		// node n at SIM_PORT + n, per seed
+#define SIM_NODE_PORT(n)	(SIM_PORT + seed % 64 * SIM_MAX_NODES + (n))
+#define SIM_MAX_NODES		16
+#define SIM_RECS		512		// played items kept per node
+#define SIM_START_US		500000		// stream start
+#define SIM_SETTLE_US		5000000		// not counted
+#define SIM_STEP_US		200		// loop period
+#define SIM_PENDING		64		// delayed packets per node
+
+#define SRC_FRAMES		512		// frames per A2DP packet
+#define SRC_PPM			20		// mean source clock error
+#define SRC_JITTER_US		3000		// packet arrival jitter
+#define BT_SKEW_US		20000		// per node arrival delay, at most
+#define RING_FRAMES		4096		// 16KB ring buffer
+#define ITEM_FRAMES		1024		// most frames per ring buffer item
+#define OUT_BUF_FRAMES		96		// S/PDIF buffer
+#define OUT_QUEUE_FRAMES	(8 * OUT_BUF_FRAMES)	// DMA buffers
+#define WAKE_US			50		// audio task wake-up latency, at most
+
+// item played by a node
+typedef struct {
+    double t;			// real time of the first frame in us
+    double index;		// stream position of the first frame
+    double len;			// frames
+} sim_rec_t;
+
+typedef struct {
+    volatile uint32_t n;	// records written
+    volatile bool locked;	// slave follows the master
+    double rate;		// frames per real second
+    sim_rec_t rec[SIM_RECS];
+} sim_node_t;
+
+typedef struct {
+    int64_t real_us;		// delivery time
+    struct sockaddr_in from;
+    size_t len;
+    uint8_t buf[SYNC_PACKET_SIZE];
+} sim_packet_t;
+
+static int nodes = 3;
+static double seconds = 20;
+static int rate = 44100;
+static double ppm_range = 30;
+static double src_range = 0;
+static double delay_us = 500;
+static double max_error = 12;
+static unsigned seed = 1;
+
+static sim_node_t *sim;			// shared with the nodes
+static double node_ppm[SIM_MAX_NODES];
+static double src_ppm[SIM_MAX_NODES];	// A2DP source clock error
+static int64_t node_offset[SIM_MAX_NODES];
+static struct timespec sim_start;
+
+static int64_t real_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - sim_start.tv_sec) * 1000000LL + (ts.tv_nsec - sim_start.tv_nsec) / 1000;
+}
+
+// node's clock at a real time
+static int64_t local_us(int id, double real)
+{
+    return node_offset[id] + llround(real * (1 + node_ppm[id] * 1e-6));
+}
+
+static double uniform(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static void node_send(int sock, const uint8_t *buf, size_t len, int to)
+{
+    struct sockaddr_in addr = {
+	.sin_family = AF_INET,
+	.sin_port = htons(SIM_NODE_PORT(to)),
+	.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    sendto(sock, buf, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+static void node_record(int id, double t, double index, double len)
+{
+    sim_node_t *node = &sim[id];
+    sim_rec_t *rec = &node->rec[node->n % SIM_RECS];
+
+    rec->t = t;
+    rec->index = index;
+    rec->len = len;
+    __sync_synchronize();
+    node->n++;
+}
+
+static void node_run(int id)
+{
+    struct sockaddr_in addr = {
+	.sin_family = AF_INET,
+	.sin_port = htons(SIM_NODE_PORT(id)),
+	.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    static sim_packet_t pending[SIM_PENDING];
+    int npending = 0;
+    int64_t end_us = seconds * 1e6;
+    int64_t next_poll = 0;
+    double out_rate = rate * (1 + node_ppm[id] * 1e-6) / 1e6;	// frames per real us
+    double src_period = SRC_FRAMES * 1e6 / (rate * (1 + src_ppm[id] * 1e-6));
+    double bt_skew, src_next;
+    int64_t out_start;
+    long src_packets = 0;
+    int64_t written = 0;		// frames sent to the output
+    int64_t index = 0;			// stream position
+    int ring = 0, ring_min = RING_FRAMES, ring_max = 0, overflow = 0, empty = 0;
+    bool started = false;
+    sync_status_t st;
+
+    srand(seed * 1000 + id);
+    bt_skew = uniform() * BT_SKEW_US;
+    src_next = SIM_START_US + bt_skew;
+    out_start = SIM_START_US + uniform() * BT_SKEW_US;
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	perror("bind");
+	exit(1);
+    }
+    fcntl(sock, F_SETFL, O_NONBLOCK);
+    sync_init(id == 0 ? SYNC_MASTER : SYNC_SLAVE, id + 1);
+    sim[id].rate = out_rate;
+
+    for (int64_t now = real_us(); now < end_us; now = real_us()) {
+	sim_packet_t *p;
+	socklen_t alen = sizeof(addr);
+	ssize_t len;
+	uint8_t reply[SYNC_PACKET_SIZE];
+
+	// receive, deliver after a random delay
+	while (npending < SIM_PENDING &&
+	       (len = recvfrom(sock, pending[npending].buf, SYNC_PACKET_SIZE, 0,
+			       (struct sockaddr *)&pending[npending].from, &alen)) > 0) {
+	    p = &pending[npending++];
+	    p->len = len;
+	    p->real_us = now - delay_us * log(1 - uniform());
+	}
+	for (int i = 0; i < npending; i++) {
+	    p = &pending[i];
+	    if (p->real_us > now) {
+		continue;
+	    }
+	    if (sync_receive(p->buf, p->len, local_us(id, now), reply) > 0) {
+		node_send(sock, reply, SYNC_PACKET_SIZE, ntohs(p->from.sin_port) - SIM_NODE_PORT(0));
+	    }
+	    pending[i--] = pending[--npending];
+	}
+
+	// beacon to all nodes or time request to the master
+	if (now >= next_poll) {
+	    uint8_t buf[SYNC_PACKET_SIZE];
+	    size_t n = sync_make_packet(buf, local_us(id, now));
+
+	    for (int to = 0; to < nodes; to++) {
+		if (id == 0 ? to != 0 : to == 0) {
+		    node_send(sock, buf, n, to);
+		}
+	    }
+	    next_poll = now + (id == 0 ? SYNC_BEACON_MS : SYNC_POLL_MS) * 1000;
+	}
+
+	// A2DP packets
+	while (src_next <= now) {
+	    src_packets++;
+	    src_next = SIM_START_US + bt_skew + src_packets * src_period + uniform() * SRC_JITTER_US;
+	    if (ring + SRC_FRAMES > RING_FRAMES) {
+		overflow++;
+	    } else {
+		ring += SRC_FRAMES;
+	    }
+	}
+
+	// audio task, keeps the DMA buffers full
+	if (!started && now >= out_start) {
+	    sync_start(rate);
+	    started = true;
+	}
+	while (started && written - (now - out_start) * out_rate < OUT_QUEUE_FRAMES) {
+	    double play = out_start + written / out_rate;	// real time of the next frame
+	    int item, c;
+
+	    if (ring == 0) {
+		written += OUT_BUF_FRAMES;	// silence
+		empty += index > 0;
+		continue;
+	    }
+	    if (ring < ring_min) {
+		ring_min = ring;
+	    }
+	    if (ring > ring_max) {
+		ring_max = ring;
+	    }
+	    item = ring < ITEM_FRAMES ? ring : ITEM_FRAMES;
+	    c = sync_playout(local_us(id, play) + uniform() * WAKE_US, item, ring, RING_FRAMES);
+	    if (c > 0) {
+		node_record(id, play, index + c, item - c);
+	    } else {
+		node_record(id, play - c / out_rate, index, item);
+	    }
+	    written += item - c;
+	    index += item;
+	    ring -= item;
+	}
+	if (id != 0) {
+	    sync_get_status(&st);
+	    sim[id].locked = st.locked;
+	}
+	usleep(SIM_STEP_US);
+    }
+
+    sync_get_status(&st);
+    if (id == 0) {
+	printf("node 0 master %+6.1fppm: source %+.1fppm, dropped %u inserted %u, ring %d..%d frames, "
+	       "%d overflows %d empty\n",
+	       node_ppm[id], src_ppm[id], st.dropped, st.inserted, ring_min, ring_max, overflow, empty);
+    } else {
+	double t = end_us;
+	int64_t offset = local_us(0, t) - local_us(id, t);
+
+	printf("node %d slave  %+6.1fppm: %s, offset error %+lldus, rtt %dus, drift %+.2fppm (true %+.2fppm),\n"
+	       "                         source %+.1fppm, dropped %u inserted %u trims %u, level breaks %u,\n"
+	       "                         ring %d..%d frames, %d overflows %d empty\n",
+	       id, node_ppm[id], st.locked ? "locked" : st.level_control ? "keeping the level" : "not locked",
+	       (long long)(st.offset_us - offset), st.rtt_us,
+	       st.drift_ppb / 1000.0, (node_ppm[0] - node_ppm[id]) / (1 + node_ppm[id] * 1e-6),
+	       src_ppm[id], st.dropped, st.inserted, st.trims, st.level_breaks,
+	       ring_min, ring_max, overflow, empty);
+    }
+    fflush(stdout);
+    exit(overflow > 0);
+}
+
+// stream position played by a node at a real time
+static bool sim_position(int id, double t, double *index)
+{
+    sim_node_t *node = &sim[id];
+    uint32_t n = node->n;
+
+    __sync_synchronize();
+    // the oldest and the newest record may be overwritten or written
+    for (uint32_t i = 1; i + 2 < SIM_RECS && i <= n; i++) {
+	const sim_rec_t *rec = &node->rec[(n - i) % SIM_RECS];
+
+	if (t >= rec->t && t < rec->t + rec->len / node->rate) {
+	    *index = rec->index + (t - rec->t) * node->rate;
+	    return true;
+	}
+    }
+    return false;
+}
+
+static int usage(void)
+{
+    fprintf(stderr, "usage: sync_sim [-n nodes] [-t seconds] [-r rate] [-p ppm] [-S src_ppm]\n"
+	    "                [-d delay_us] [-e max_error] [-s seed]\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    double worst = 0, sum = 0;
+    long samples = 0;
+    int opt, fail = 0;
+
+    while ((opt = getopt(argc, argv, "n:t:r:p:S:d:e:s:")) != -1) {
+	switch (opt) {
+	case 'n': nodes = atoi(optarg); break;
+	case 't': seconds = atof(optarg); break;
+	case 'r': rate = atoi(optarg); break;
+	case 'p': ppm_range = atof(optarg); break;
+	case 'S': src_range = atof(optarg); break;
+	case 'd': delay_us = atof(optarg); break;
+	case 'e': max_error = atof(optarg); break;
+	case 's': seed = atoi(optarg); break;
+	default: return usage();
+	}
+    }
+    if (nodes < 2 || nodes > SIM_MAX_NODES || seconds * 1e6 <= SIM_SETTLE_US) {
+	return usage();
+    }
+
+    sim = mmap(NULL, nodes * sizeof(sim_node_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sim == MAP_FAILED) {
+	perror("mmap");
+	return 1;
+    }
+    srand(seed);
+    for (int id = 0; id < nodes; id++) {
+	node_ppm[id] = (2 * uniform() - 1) * ppm_range;
+	node_offset[id] = uniform() * 1e12;
+    }
+    for (int id = 0; id < nodes; id++) {
+	double d = id == 1 ? 1 : id == 2 ? -1 : 2 * uniform() - 1;
+
+	src_ppm[id] = SRC_PPM + (id ? d * src_range : 0);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &sim_start);
+    for (int id = 0; id < nodes; id++) {
+	if (fork() == 0) {
+	    node_run(id);
+	}
+    }
+
+    // compare the slaves with the master, 100ms behind the recording
+    for (int64_t now = real_us(); now < seconds * 1e6; now = real_us()) {
+	double t = now - 100000;
+	double master, slave;
+
+	if (t >= SIM_SETTLE_US && sim_position(0, t, &master)) {
+	    for (int id = 1; id < nodes; id++) {
+		if (sim[id].locked && sim_position(id, t, &slave)) {
+		    double e = fabs(slave - master);
+
+		    worst = e > worst ? e : worst;
+		    sum += e;
+		    samples++;
+		}
+	    }
+	}
+	usleep(1000);
+    }
+    for (int id = 0; id < nodes; id++) {
+	int status;
+
+	wait(&status);
+	fail |= !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+
+    printf("%d nodes, %dHz, delay %.0fus: slave error mean %.2f, max %.2f frames (%ld samples)\n",
+	   nodes, rate, delay_us, samples ? sum / samples : 0, worst, samples);
+    return fail || !samples || worst > max_error;
+}